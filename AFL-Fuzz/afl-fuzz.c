@@ -42,6 +42,8 @@
 #include "debug.h"
 #include "alloc-inl.h"
 #include "hash.h"
+#include "cmplog.h"
+#include "forkserver.h"
 
 #include "../Utility/FGoDefs.h"
 #include "../Utility/FGoFuzzingHelper.h"
@@ -74,6 +76,10 @@
 
 #if AFLGO_IMPL
 #include <math.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <elf.h>
+#endif /* __linux__ */
 #endif // AFLGO_IMPL
 
 #if defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__)
@@ -121,6 +127,99 @@ static u32 stats_update_freq = 1; /* Stats update frequency (execs)   */
 
 static u8 cooling_schedule = 0; /* Cooling schedule for directed fuzzing */
 
+static u8 dist_sched,         /* Distance-prioritized scheduling?  */
+    dist_sched_picked;        /* Current entry picked by distance? */
+static u32 dist_sched_explore = DIST_SCHED_EXPLORE; /* % of in-order picks */
+
+static u8 dist_prune;         /* Retire far seeds after -c time?   */
+static u32 queued_retired;    /* Seeds retired by pruning          */
+static u32 sync_skipped;      /* Peer seeds skipped from metadata  */
+static u8 dist_grad;          /* Infer distance-sensitive bytes?   */
+static u8 dist_det;           /* Deterministic steps by distance?  */
+static u8 dist_trim;          /* Trim keeping the distances?       */
+static u8 dist_novelty;       /* Keep inputs getting closer?       */
+static u32 queued_dist_novel; /* Inputs kept for getting closer    */
+static u8 reach_cov;          /* Favor edges reaching a target?    */
+static u8 *reach_mask,        /* Edges that can reach a target     */
+    *reach_seen;              /* Such edges seen by queued seeds   */
+static u32 reach_edges,       /* Edges in reach_mask               */
+    reach_edges_seen,         /* Edges in reach_seen               */
+    queued_reach_cov,         /* Paths with new target-edge tuples */
+    favored_reach;            /* Favored for target edges          */
+static u8 cmplog_mode;        /* Input-to-state stage near targets?*/
+static s32 cmplog_shm_id = -1; /* ID of the comparison log SHM     */
+static struct cmp_map *cmp_map; /* Comparison log of the target    */
+static u32 cmplog_seeds;      /* Seeds through input-to-state      */
+static u64 dist_trim_saved,   /* Bytes removed by directed trims   */
+    dist_trim_execs;          /* Execs done by directed trims      */
+static u8 *san_path;          /* Sanitized binary for replays      */
+static char **san_argv;       /* Its command line                  */
+static s32 san_shm_id = -1;   /* ID of its SHM                     */
+static struct fsrv san_fsrv;  /* Its fork server                   */
+static u8 *san_trace_bits;    /* Its bitmap and distance region    */
+static u64 san_execs,         /* Replays through it                */
+    san_crashes,              /* Crashes found by replays only     */
+    san_time_ms;              /* Time spent in replays             */
+static u8 virgin_san[MAP_SIZE], /* Reaching paths not replayed yet */
+    virgin_san_crash[MAP_SIZE]; /* Bits not seen in its crashes    */
+
+/* FGo: distance buckets of the seeds for -D. */
+
+enum
+{
+  /* 00 */ DIST_BUCKET_NEAR,
+  /* 01 */ DIST_BUCKET_MID,
+  /* 02 */ DIST_BUCKET_FAR
+};
+
+static u64 bucket_finds[3][32],  /* Patterns found per bucket, stage */
+    bucket_cycles[3][32],        /* Execs per bucket, stage          */
+    bucket_det_ms[3],            /* Time in deterministic steps      */
+    bucket_havoc_ms[3];          /* Time in havoc and splicing       */
+static u32 bucket_seeds[3];      /* Seeds fuzzed per bucket          */
+
+/* FGo: record of the queue index, queue/.state/index, to which every queue
+   entry is appended once it is on disk, and again whenever trimming
+   rewrites it. Peers tail the index instead of scanning the queue
+   directory; a later record of an entry supersedes the earlier ones. */
+
+struct queue_index_rec
+{
+  u32 size,         /* Bytes of the record, name included */
+      id,           /* Queue entry id                     */
+      len,          /* Test case length                   */
+      cksum,        /* Checksum of the test case          */
+      target_count; /* Transitional distances that follow */
+
+  /* Followed by u32 tr[target_count] and the NUL-padded file name */
+};
+
+static s32 queue_index_fd = -1; /* Our queue index, when syncing       */
+
+static u32 *queue_cksums;    /* Checksums of our test cases, hashed */
+static u32 queue_cksums_cnt, /* Checksums in the set                */
+    queue_cksums_size;       /* Slots in the set                    */
+
+struct sync_peer
+{
+  u8 *name;               /* Sync id of the peer              */
+  u8 index_broken;        /* Index unusable, scan the queue?  */
+  struct sync_peer *next; /* Next peer                        */
+};
+
+/* FGo: how far the index of a peer was read, kept in <out_dir>/.synced/
+   after the id of the last seen test case, so that a resumed instance
+   goes on where it stopped. */
+
+struct sync_index_state
+{
+  u64 pos, /* Bytes of the index already read  */
+      ino; /* Inode of the index read          */
+};
+
+static struct sync_peer *sync_peers; /* Peers seen so far               */
+static s32 sync_inotify_fd = -1;     /* Watches of the peer indices     */
+
 enum
 {
   /* 00 */ SAN_EXP, /* Exponential schedule                  */
@@ -177,6 +276,11 @@ static u8 var_bytes[MAP_SIZE]; /* Bytes that appear to be variable */
 
 static s32 shm_id; /* ID of the SHM region             */
 
+static s32 shm_fuzz_id = -1; /* ID of the test case SHM region   */
+static u8 *shm_fuzz_buf;     /* SHM with the test case (len+data)*/
+static u32 shm_fuzz_opts;    /* Negotiated test case delivery    */
+static u32 shm_fuzz_len;     /* Length of the current test case  */
+
 static volatile u8 stop_soon, /* Ctrl-C pressed?                  */
     clear_screen = 1,         /* Window resized?                  */
     child_timed_out;          /* Traced process timed out?        */
@@ -285,9 +389,15 @@ struct queue_entry
 #if AFLGO_IMPL
   // double distance; /* Distance to targets              */
 
-  double df_distance[FGO_TARGET_MAX_COUNT]; /* FGo: depth-first distance (average) */
-  double bt_distance[FGO_TARGET_MAX_COUNT]; /* FGo: backtrace distance (average) */
-  u32 tr_distance[FGO_TARGET_MAX_COUNT];    /* FGo: transitional distance */
+  u32 dist_id;     /* FGo: row in the seed distance table */
+  u32 sched_picks; /* FGo: times picked by distance     */
+  u8 retired;      /* FGo: retired by far-seed pruning  */
+
+  u8 dist_inferred; /* FGo: distance bytes inferred?     */
+  u32 *dist_pos,    /* FGo: distance-sensitive offsets   */
+      dist_pos_cnt; /* FGo: number of such offsets       */
+
+  u8 cmplog_done; /* FGo: input-to-state stage done?   */
 
 #endif // AFLGO_IMPL
 
@@ -308,6 +418,9 @@ struct extra_data
   u8 *data;    /* Dictionary token data            */
   u32 len;     /* Dictionary token length          */
   u32 hit_cnt; /* Use count in the corpus          */
+#if AFLGO_IMPL
+  u32 dist;    /* FGo: distance of the code using it */
+#endif // AFLGO_IMPL
 };
 
 static struct extra_data *extras; /* Extra tokens to fuzz with        */
@@ -316,6 +429,10 @@ static u32 extras_cnt;            /* Total number of tokens read      */
 static struct extra_data *a_extras; /* Automatically selected extras    */
 static u32 a_extras_cnt;            /* Total number of tokens available */
 
+#if AFLGO_IMPL
+static u8 extras_by_dist;           /* extras[] ordered by proximity?   */
+#endif // AFLGO_IMPL
+
 #if AFLGO_IMPL
 
 // static double cur_distance = -1.0; /* Distance of executed input             */
@@ -331,11 +448,72 @@ static double max_bt_distance[FGO_TARGET_MAX_COUNT] = {-1.0};
 static double min_df_distance[FGO_TARGET_MAX_COUNT] = {-1.0};
 static double min_bt_distance[FGO_TARGET_MAX_COUNT] = {-1.0};
 static uint32_t cur_tr_distance[FGO_TARGET_MAX_COUNT] = {INT32_MAX};
+static u8 cur_df_hit[FGO_TARGET_MAX_COUNT]; /* DF hits in the last run  */
+static u32 min_tr_distance[FGO_TARGET_MAX_COUNT]; /* Best tr of own seeds */
+
+static double target_weight[FGO_TARGET_MAX_COUNT]; /* Weights in the energy */
+static double reached_weight = 1.0;                /* Factor once reached   */
+static u8 target_weights_zero;                     /* All weights 0?        */
+
+static u8 target_reached[FGO_TARGET_MAX_COUNT];     /* Target executed?      */
+static u64 target_reach_ms[FGO_TARGET_MAX_COUNT];   /* First reach, from start */
+static u32 target_reach_seed[FGO_TARGET_MAX_COUNT]; /* Id of the first seed  */
+static u32 targets_reached;                         /* Targets executed      */
+
+static u64 target_san_execs[FGO_TARGET_MAX_COUNT];   /* Reach events replayed */
+static u64 target_san_crashes[FGO_TARGET_MAX_COUNT]; /* Of which crashed      */
+static u64 target_san_ms[FGO_TARGET_MAX_COUNT];      /* Time spent in them    */
 
 static target_info_t target_info;
 
 static char *target_info_dir = NULL;
 
+static u32 dist_region_size;     /* Bytes of the distance region in use  */
+static u8 *dist_region_template; /* Distance region content before a run */
+
+/* FGo: distances of the seeds to the targets, one row of target_count values
+   per seed, indexed by queue_entry->dist_id. They are kept apart from the
+   queue entries and sized to the real target count, so that loops over the
+   distances walk contiguous memory. */
+
+static struct
+{
+  float *df;    /* Depth-first distances (average)  */
+  float *bt;    /* Backtrace distances (average)    */
+  u32 *tr;      /* Transitional distances           */
+  u8 *df_hit;   /* df is measured, not the max      */
+  u32 rows,     /* Rows in use                      */
+      max_rows; /* Rows allocated                   */
+
+  /* Per seed, not per target: the directed part of the energy, cached */
+
+  double *prob_trans, /* Mean quantile of tr distances    */
+      *prob;          /* Mean of the normalized distances */
+  u32 *prob_epoch;    /* Epoch of prob, 0 if not computed */
+} seed_dist;
+
+/* FGo: bumped when the min/max distances of any target change. The epoch is
+   global rather than per target: the directed part of the energy of every
+   seed normalizes its distances to all the targets, so a change on any one
+   of them invalidates the cached value of every seed anyway. */
+
+static u32 dist_extreme_epoch = 1;
+
+/* FGo: min-heap of seeds for distance-prioritized scheduling. */
+
+struct dist_heap_node
+{
+  double key;             /* Directed energy part + penalty   */
+  struct queue_entry *q;  /* Seed                             */
+};
+
+static struct dist_heap_node *dist_heap; /* Heap of all the seeds          */
+static u32 dist_heap_len,                /* Seeds in the heap              */
+    dist_heap_size,                      /* Nodes allocated                */
+    dist_heap_epoch,                     /* Extremes epoch of the keys     */
+    dist_sched_cnt;                      /* Picks in the current cycle     */
+static struct queue_entry *dist_sched_rr; /* Cursor of the in-order picks  */
+
 // // FGo: Debug: file handler
 // static FILE *fgo_file_handler = NULL;
 
@@ -369,7 +547,9 @@ enum
   /* 13 */ STAGE_EXTRAS_UI,
   /* 14 */ STAGE_EXTRAS_AO,
   /* 15 */ STAGE_HAVOC,
-  /* 16 */ STAGE_SPLICE
+  /* 16 */ STAGE_SPLICE,
+  /* 17 */ STAGE_DIST_INFER,
+  /* 18 */ STAGE_CMPLOG
 };
 
 /* Stage value types */
@@ -851,6 +1031,30 @@ static void mark_as_redundant(struct queue_entry *q, u8 state)
 
 #if AFLGO_IMPL
 
+/* FGo: note whether all the targets have a zero weight, e.g. once all are
+   reached with -R 0. The energy then falls back to unweighted means rather
+   than being 0, i.e. the closest possible, for every seed. */
+
+static void update_target_weights_zero(void)
+{
+
+  target_weights_zero = 1;
+
+  for (u32 i = 0; i < target_info.target_count; ++i)
+    if (target_weight[i])
+    {
+      target_weights_zero = 0;
+      break;
+    }
+}
+
+/* FGo: get the weight of a target in the energy of the seeds. */
+
+static inline double get_target_weight(u32 target_id)
+{
+  return target_weights_zero ? 1.0 : target_weight[target_id];
+}
+
 static void load_target_info()
 {
   // const char *target_envar = "FGO_TARGET_COUNT";
@@ -882,6 +1086,160 @@ static void load_target_info()
   }
 
   helper_load_target_info(target_info_dir, &target_info);
+
+  /* Only the slots of the active targets are written by the target, so
+     only these are reset before each run, from a prebuilt template. */
+
+  if (target_info.target_count > FGO_TARGET_MAX_COUNT)
+    FATAL("Too many targets (%u, limit is %u)", target_info.target_count, FGO_TARGET_MAX_COUNT);
+
+  dist_region_size = target_info.target_count * FGO_DIST_SLOT_SIZE;
+  dist_region_template = ck_alloc(dist_region_size);
+
+  for (u32 i = 0; i < target_info.target_count; ++i)
+  {
+    *(u64 *)(dist_region_template + i * FGO_DIST_SLOT_SIZE + FGO_DIST_SLOT_MIN_OFFSET) = INT32_MAX;
+    cur_tr_distance[i] = INT32_MAX;
+    min_tr_distance[i] = INT32_MAX;
+    target_weight[i] = target_info.target_weight ? target_info.target_weight[i] : 1.0;
+  }
+
+  update_target_weights_zero();
+}
+
+/* FGo: read a section of the target binary, into which the linker put the
+   sections of the same name of all its objects. Returns NULL if there is
+   no such section, or if the binary is not a 64-bit ELF file. */
+
+static u8 *read_binary_section(const u8 *sec_name, u32 *size)
+{
+
+  u8 *ret = NULL;
+
+#ifdef __linux__
+
+  struct stat st;
+  Elf64_Ehdr *eh;
+  Elf64_Shdr *sh;
+  u8 *f_data, *names;
+  s32 fd;
+  u32 i;
+
+  fd = open(target_path, O_RDONLY);
+  if (fd < 0)
+    PFATAL("Unable to open '%s'", target_path);
+
+  if (fstat(fd, &st))
+    PFATAL("fstat() failed");
+
+  f_data = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (f_data == MAP_FAILED)
+    PFATAL("Unable to mmap file '%s'", target_path);
+
+  close(fd);
+
+  eh = (Elf64_Ehdr *)f_data;
+
+  if (st.st_size < sizeof(Elf64_Ehdr) || memcmp(f_data, ELFMAG, SELFMAG) ||
+      f_data[EI_CLASS] != ELFCLASS64 || eh->e_shentsize != sizeof(Elf64_Shdr) ||
+      eh->e_shoff + (u64)eh->e_shnum * sizeof(Elf64_Shdr) > st.st_size ||
+      eh->e_shstrndx >= eh->e_shnum)
+    goto unmap;
+
+  sh = (Elf64_Shdr *)(f_data + eh->e_shoff);
+  names = f_data + sh[eh->e_shstrndx].sh_offset;
+
+  if (sh[eh->e_shstrndx].sh_offset + sh[eh->e_shstrndx].sh_size > st.st_size)
+    goto unmap;
+
+  for (i = 0; i < eh->e_shnum; i++)
+  {
+
+    if (sh[i].sh_name >= sh[eh->e_shstrndx].sh_size ||
+        strncmp(names + sh[i].sh_name, sec_name, sh[eh->e_shstrndx].sh_size - sh[i].sh_name) ||
+        sh[i].sh_type == SHT_NOBITS || sh[i].sh_offset + sh[i].sh_size > st.st_size)
+      continue;
+
+    *size = sh[i].sh_size;
+    ret = ck_alloc(*size + 1);
+    memcpy(ret, f_data + sh[i].sh_offset, *size);
+    break;
+  }
+
+unmap:
+
+  munmap(f_data, st.st_size);
+
+#endif /* __linux__ */
+
+  return ret;
+}
+
+/* FGo: load the mask of the edges that can reach a target, from the indices
+   the pass embedded into REACH_EDGES_SECTION of every object. Only the
+   objects linked into the binary count. Zeros are padding. */
+
+static void load_reach_mask(void)
+{
+
+  u32 size = 0, i;
+  u32 *edges = (u32 *)read_binary_section(REACH_EDGES_SECTION, &size);
+
+  if (!edges)
+    FATAL("No section '" REACH_EDGES_SECTION "' in '%s' (was the target built with this FGo?)",
+          target_path);
+
+  reach_mask = ck_alloc(MAP_SIZE >> 3);
+  reach_seen = ck_alloc(MAP_SIZE >> 3);
+
+  for (i = 0; i < size / sizeof(u32); i++)
+  {
+
+    u32 idx = edges[i] - 1;
+
+    if (!edges[i] || idx >= MAP_SIZE || (reach_mask[idx >> 3] & (1 << (idx & 7))))
+      continue;
+
+    reach_mask[idx >> 3] |= 1 << (idx & 7);
+    reach_edges++;
+  }
+
+  ck_free(edges);
+
+  if (!reach_edges)
+    FATAL("No edge reaching a target in '%s'", target_path);
+
+  OKF("Loaded %u edges reaching targets.", reach_edges);
+}
+
+/* FGo: decode the distances of the last run from the distance region of the
+   SHM into cur_*_distance. Only inputs that are kept need them, so this is
+   done apart from has_new_bits(), which runs after every exec. Targets not
+   reached at all get the maximal distance seen so far; cur_df_hit tells
+   such DF placeholders from measured distances. */
+
+EXP_ST void decode_target_distances(u8 *dist_region)
+{
+
+  for (u32 i = 0; i < target_info.target_count; ++i)
+  {
+    u64 *slot = (u64 *)(dist_region + i * FGO_DIST_SLOT_SIZE);
+    u64 df_cnt = slot[FGO_DIST_SLOT_DF_CNT_OFFSET / 8];
+    u64 df_dist = slot[FGO_DIST_SLOT_DF_DIST_OFFSET / 8];
+    u64 bt_cnt = slot[FGO_DIST_SLOT_BT_CNT_OFFSET / 8];
+    u64 bt_dist = slot[FGO_DIST_SLOT_BT_DIST_OFFSET / 8];
+
+    cur_df_hit[i] = !!df_cnt;
+    if (!df_cnt)
+      cur_df_distance[i] = max_df_distance[i];
+    else
+      cur_df_distance[i] = (double)df_dist / (double)df_cnt;
+    if (!bt_cnt)
+      cur_bt_distance[i] = max_bt_distance[i];
+    else
+      cur_bt_distance[i] = (double)bt_dist / (double)bt_cnt;
+    cur_tr_distance[i] = (u32)slot[FGO_DIST_SLOT_MIN_OFFSET / 8];
+  }
 }
 
 static void update_df_extreme_value(u32 index)
@@ -892,11 +1250,18 @@ static void update_df_extreme_value(u32 index)
     {
       max_df_distance[index] = cur_df_distance[index];
       min_df_distance[index] = cur_df_distance[index];
+      dist_extreme_epoch++;
     }
     if (cur_df_distance[index] > max_df_distance[index])
+    {
       max_df_distance[index] = cur_df_distance[index];
+      dist_extreme_epoch++;
+    }
     if (cur_df_distance[index] < min_df_distance[index])
+    {
       min_df_distance[index] = cur_df_distance[index];
+      dist_extreme_epoch++;
+    }
   }
 }
 
@@ -908,648 +1273,1129 @@ static void update_bt_extreme_value(u32 index)
     {
       max_bt_distance[index] = cur_bt_distance[index];
       min_bt_distance[index] = cur_bt_distance[index];
+      dist_extreme_epoch++;
     }
     if (cur_bt_distance[index] > max_bt_distance[index])
+    {
       max_bt_distance[index] = cur_bt_distance[index];
+      dist_extreme_epoch++;
+    }
     if (cur_bt_distance[index] < min_bt_distance[index])
+    {
       min_bt_distance[index] = cur_bt_distance[index];
+      dist_extreme_epoch++;
+    }
   }
 }
 
-#endif // AFLGO_IMPL
-
-/* Append new test case to the queue. */
+/* FGo: get a new, zeroed row in the seed distance table. */
 
-static void add_to_queue(u8 *fname, u32 len, u8 passed_det)
+static u32 alloc_seed_dist_row(void)
 {
 
-  struct queue_entry *q = ck_alloc(sizeof(struct queue_entry));
+  if (seed_dist.rows == seed_dist.max_rows)
+  {
+    u32 cnt = target_info.target_count ? target_info.target_count : 1;
 
-  q->fname = fname;
-  q->len = len;
-  q->depth = cur_depth + 1;
-  q->passed_det = passed_det;
+    seed_dist.max_rows = seed_dist.max_rows ? seed_dist.max_rows * 2 : 1024;
+    seed_dist.df = ck_realloc(seed_dist.df, seed_dist.max_rows * cnt * sizeof(float));
+    seed_dist.bt = ck_realloc(seed_dist.bt, seed_dist.max_rows * cnt * sizeof(float));
+    seed_dist.tr = ck_realloc(seed_dist.tr, seed_dist.max_rows * cnt * sizeof(u32));
+    seed_dist.df_hit = ck_realloc(seed_dist.df_hit, seed_dist.max_rows * cnt);
+    seed_dist.prob_trans = ck_realloc(seed_dist.prob_trans, seed_dist.max_rows * sizeof(double));
+    seed_dist.prob = ck_realloc(seed_dist.prob, seed_dist.max_rows * sizeof(double));
+    seed_dist.prob_epoch = ck_realloc(seed_dist.prob_epoch, seed_dist.max_rows * sizeof(u32));
+  }
 
-#if AFLGO_IMPL
+  return seed_dist.rows++;
+}
 
-  // q->distance = cur_distance;
+/* FGo: rows of the seed distance table for a seed. */
 
-  // if (cur_distance > 0)
-  // {
+static inline float *seed_df_distance(struct queue_entry *q)
+{
+  return seed_dist.df + (u64)q->dist_id * target_info.target_count;
+}
 
-  //   if (max_distance <= 0)
-  //   {
-  //     max_distance = cur_distance;
-  //     min_distance = cur_distance;
-  //   }
-  //   if (cur_distance > max_distance)
-  //     max_distance = cur_distance;
-  //   if (cur_distance < min_distance)
-  //     min_distance = cur_distance;
-  // }
+static inline float *seed_bt_distance(struct queue_entry *q)
+{
+  return seed_dist.bt + (u64)q->dist_id * target_info.target_count;
+}
 
-  /* FGo */
-  for (u32 i = 0; i < target_info.target_count; ++i)
-  {
-    q->df_distance[i] = cur_df_distance[i];
-    update_df_extreme_value(i);
-    q->bt_distance[i] = cur_bt_distance[i];
-    update_bt_extreme_value(i);
-    q->tr_distance[i] = cur_tr_distance[i];
-  }
+static inline u32 *seed_tr_distance(struct queue_entry *q)
+{
+  return seed_dist.tr + (u64)q->dist_id * target_info.target_count;
+}
 
-#endif // AFLGO_IMPL
+static inline u8 *seed_df_hit(struct queue_entry *q)
+{
+  return seed_dist.df_hit + (u64)q->dist_id * target_info.target_count;
+}
 
-  if (q->depth > max_depth)
-    max_depth = q->depth;
+/* FGo: record that a seed executed a target for the first time, with a
+   symlink to it in targets/. With -R, the target then gets a lower weight
+   in the energy of the seeds, so that the energy goes to the open ones. */
 
-  if (queue_top)
-  {
+static void mark_target_reached(struct queue_entry *q, u32 target_id)
+{
 
-    queue_top->next = q;
-    queue_top = q;
-  }
-  else
-    q_prev100 = queue = queue_top = q;
+  u8 *fn = strrchr(q->fname, '/') + 1, *ldest;
 
-  queued_paths++;
-  pending_not_fuzzed++;
+  target_reached[target_id] = 1;
+  target_reach_ms[target_id] = get_cur_time() - start_time;
+  sscanf(fn, "id%*c%06u", &target_reach_seed[target_id]);
+  targets_reached++;
 
-  cycles_wo_finds = 0;
+  ldest = alloc_printf("../queue/%s", fn);
+  fn = alloc_printf("%s/targets/target_%u", out_dir, target_id);
 
-  if (!(queued_paths % 100))
+  if (symlink(ldest, fn))
   {
 
-    q_prev100->next_100 = q;
-    q_prev100 = q;
+    s32 fd = open(fn, O_WRONLY | O_CREAT | O_EXCL, 0600);
+    if (fd < 0)
+      PFATAL("Unable to create '%s'", fn);
+    close(fd);
   }
 
-  last_path_time = get_cur_time();
+  ck_free(ldest);
+  ck_free(fn);
+
+  if (reached_weight != 1.0)
+  {
+    target_weight[target_id] *= reached_weight;
+    update_target_weights_zero();
+    memset(seed_dist.prob_epoch, 0, seed_dist.rows * sizeof(u32));
+    dist_extreme_epoch++;
+  }
 }
 
-/* Destroy the entire queue. */
+/* FGo: store the decoded distances of the last run as the ones of a seed,
+   and update the extremes. */
 
-EXP_ST void destroy_queue(void)
+static void set_seed_distances(struct queue_entry *q)
 {
 
-  struct queue_entry *q = queue, *n;
+  float *df = seed_df_distance(q), *bt = seed_bt_distance(q);
+  u32 *tr = seed_tr_distance(q);
+  u8 *df_hit = seed_df_hit(q);
 
-  while (q)
+  for (u32 i = 0; i < target_info.target_count; ++i)
   {
-
-    n = q->next;
-    ck_free(q->fname);
-    ck_free(q->trace_mini);
-    ck_free(q);
-    q = n;
+    df[i] = cur_df_distance[i];
+    df_hit[i] = cur_df_hit[i];
+    update_df_extreme_value(i);
+    bt[i] = cur_bt_distance[i];
+    update_bt_extreme_value(i);
+    tr[i] = cur_tr_distance[i];
+    if (tr[i] < min_tr_distance[i])
+      min_tr_distance[i] = tr[i];
+    if (!tr[i] && !target_reached[i])
+      mark_target_reached(q, i);
   }
+
+  seed_dist.prob_epoch[q->dist_id] = 0;
 }
 
-/* Write bitmap to file. The bitmap is useful mostly for the secret
-   -B option, to focus a separate fuzzing session on a particular
-   interesting input without rediscovering all the others. */
+/* FGo: add a checksum to the set of checksums of our test cases. */
 
-EXP_ST void write_bitmap(void)
+static void add_queue_cksum(u32 cksum)
 {
 
-  u8 *fname;
-  s32 fd;
+  u32 i;
 
-  if (!bitmap_changed)
-    return;
-  bitmap_changed = 0;
+  if (!cksum)
+    cksum = 1;
 
-  fname = alloc_printf("%s/fuzz_bitmap", out_dir);
-  fd = open(fname, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if ((queue_cksums_cnt + 1) * 2 > queue_cksums_size)
+  {
+    u32 *old = queue_cksums, old_size = queue_cksums_size;
 
-  if (fd < 0)
-    PFATAL("Unable to open '%s'", fname);
+    queue_cksums_size = old_size ? old_size * 2 : 4096;
+    queue_cksums = ck_alloc(queue_cksums_size * sizeof(u32));
+    queue_cksums_cnt = 0;
 
-  ck_write(fd, virgin_bits, MAP_SIZE, fname);
+    for (i = 0; i < old_size; ++i)
+      if (old[i])
+        add_queue_cksum(old[i]);
 
-  close(fd);
-  ck_free(fname);
+    ck_free(old);
+  }
+
+  for (i = cksum & (queue_cksums_size - 1); queue_cksums[i];
+       i = (i + 1) & (queue_cksums_size - 1))
+    if (queue_cksums[i] == cksum)
+      return;
+
+  queue_cksums[i] = cksum;
+  queue_cksums_cnt++;
 }
 
-/* Read bitmap from file. This is for the -B option again. */
+/* FGo: check whether one of our test cases has this checksum. */
 
-EXP_ST void read_bitmap(u8 *fname)
+static u8 has_queue_cksum(u32 cksum)
 {
 
-  s32 fd = open(fname, O_RDONLY);
+  if (!queue_cksums_size)
+    return 0;
 
-  if (fd < 0)
-    PFATAL("Unable to open '%s'", fname);
+  if (!cksum)
+    cksum = 1;
 
-  ck_read(fd, virgin_bits, MAP_SIZE, fname);
+  for (u32 i = cksum & (queue_cksums_size - 1); queue_cksums[i];
+       i = (i + 1) & (queue_cksums_size - 1))
+    if (queue_cksums[i] == cksum)
+      return 1;
 
-  close(fd);
+  return 0;
 }
 
-/* Check if the current execution path brings anything new to the table.
-   Update virgin bits to reflect the finds. Returns 1 if the only change is
-   the hit-count for a particular tuple; 2 if there are new tuples seen.
-   Updates the map, so subsequent calls will always return 0.
-
-   This function is called after every exec() on a fairly large buffer, so
-   it needs to be fast. We do this in 32-bit and 64-bit flavors. */
+/* FGo: once a queue entry is on disk, and again after trimming rewrote it,
+   append it to our queue index, with the checksum of its content and its
+   transitional distances. A record is written at once, so that peers never
+   see half of it. */
 
-static inline u8 has_new_bits(u8 *virgin_map)
+static void index_queue_entry(struct queue_entry *q, u8 *mem)
 {
 
-#ifdef WORD_SIZE_64
+  u8 *fn = strrchr(q->fname, '/') + 1;
+  u32 cnt = target_info.target_count;
+  u32 name_size = (strlen(fn) + 4) & ~3;
+  u32 size = sizeof(struct queue_index_rec) + cnt * sizeof(u32) + name_size;
+  struct queue_index_rec *rec;
 
-  u64 *current = (u64 *)trace_bits;
-  u64 *virgin = (u64 *)virgin_map;
+  if (queue_index_fd < 0)
+    return;
 
-  u32 i = (MAP_SIZE >> 3);
+  rec = ck_alloc(size);
+  rec->size = size;
+  rec->len = q->len;
+  rec->cksum = hash32(mem, q->len, HASH_CONST);
+  rec->target_count = cnt;
+  sscanf(fn, "id%*c%06u", &rec->id);
 
-#if AFLGO_IMPL
+  memcpy(rec + 1, seed_tr_distance(q), cnt * sizeof(u32));
+  strcpy((u8 *)(rec + 1) + cnt * sizeof(u32), fn);
 
-  // /* Calculate distance of current input to targets */
+  add_queue_cksum(rec->cksum);
 
-  // u64 *total_distance = (u64 *)(trace_bits + MAP_SIZE);
-  // u64 *total_count = (u64 *)(trace_bits + MAP_SIZE + 8);
+  ck_write(queue_index_fd, rec, size, "queue index");
+  ck_free(rec);
+}
 
-  // if (*total_count > 0)
-  //   cur_distance = (double)(*total_distance) / (double)(*total_count);
-  // else
-  //   cur_distance = -1.0;
+/* FGo: get the directed part of the energy of a seed in [0, 1], the mean of
+   the harmonic means of its normalized average distances and of the
+   quantiles of its transitional distances, weighted by target_weight.
+   Lower is closer. The quantiles only change with the weights, so they are
+   computed once per seed; the rest is computed again only when some
+   min/max distance changed since the last call. */
 
-  // FGo
+static double get_seed_dist_prob(struct queue_entry *q)
+{
 
-  // double tmp_dist = 0.0;
-  for (u32 i = 0; i < target_info.target_count; ++i)
+  u32 id = q->dist_id;
+  float *q_df_distance = seed_df_distance(q), *q_bt_distance = seed_bt_distance(q);
+  u32 *q_tr_distance = seed_tr_distance(q);
+
+  if (seed_dist.prob_epoch[id] == dist_extreme_epoch)
+    return seed_dist.prob[id];
+
+  if (!seed_dist.prob_epoch[id])
   {
-    u64 *tmp_cur_df_count = (u64 *)(trace_bits + MAP_SIZE + i * 40);
-    u64 *tmp_cur_df_dist = (u64 *)(trace_bits + MAP_SIZE + i * 40 + 8);
-    u64 *tmp_cur_bt_count = (u64 *)(trace_bits + MAP_SIZE + i * 40 + 16);
-    u64 *tmp_cur_bt_dist = (u64 *)(trace_bits + MAP_SIZE + i * 40 + 24);
-    u64 *tmp_cur_min_dist = (u64 *)(trace_bits + MAP_SIZE + i * 40 + 32);
+    /* Transitional distance */
 
-    if ((*tmp_cur_df_count) == 0)
-      cur_df_distance[i] = max_df_distance[i];
-    else
-      cur_df_distance[i] = (double)(*tmp_cur_df_dist) / (double)(*tmp_cur_df_count);
-    if ((*tmp_cur_bt_count) == 0)
-      cur_bt_distance[i] = max_bt_distance[i];
-    else
-      cur_bt_distance[i] = (double)(*tmp_cur_bt_dist) / (double)(*tmp_cur_bt_count);
-    cur_tr_distance[i] = (uint32_t)(*tmp_cur_min_dist);
+    double prob_trans = 0.0, weight_sum = 0.0;
+    for (u32 i = 0; i < target_info.target_count; ++i)
+    {
+      double weight = get_target_weight(i);
+      if (!weight)
+        continue;
+      double tmp_prob_trans = helper_get_quantile(&target_info, i, q_tr_distance[i]);
+      if (tmp_prob_trans <= 0.0)
+      {
+        prob_trans = 0.0;
+        break;
+      }
+      else if (tmp_prob_trans > 1.0)
+        tmp_prob_trans = 1.0;
+      prob_trans += (weight / tmp_prob_trans);
+      weight_sum += weight;
+    }
+    if (prob_trans > 0.0)
+      prob_trans = weight_sum / prob_trans;
 
-    // u64 total_count = (*tmp_cur_df_count) + (*tmp_cur_bt_count);
-    // u64 total_dist = (*tmp_cur_df_dist) + (*tmp_cur_bt_dist);
-    // if (total_dist > 0)
-    // {
-    //   tmp_dist += (double)(total_count) / (double)(total_dist);
-    // }
+    seed_dist.prob_trans[id] = prob_trans;
+  }
 
-    // /* FGo: debug test */
-    // fprintf(fgo_file_handler, "%llu", *tmp_cur_min_dist);
-    // if (i < target_count - 1)
-    //   fprintf(fgo_file_handler, "|");
-    // else
-    //   fprintf(fgo_file_handler, "\n");
+  /* Average distance */
+
+  double prob_avg = 0.0, weight_sum = 0.0;
+  for (u32 i = 0; i < target_info.target_count; ++i)
+  {
+    double weight = get_target_weight(i);
+    if (!weight)
+      continue;
+    /* A zero range, i.e. a single distance seen so far, would give 0/0.
+       Every seed is then at the min, so its normalized distance is 0. */
+    double df_range = max_df_distance[i] - min_df_distance[i];
+    double bt_range = max_bt_distance[i] - min_bt_distance[i];
+    double tmp_prob_df = df_range > 0.0 ? (q_df_distance[i] - min_df_distance[i]) / df_range : 0.0;
+    double tmp_prob_bt = bt_range > 0.0 ? (q_bt_distance[i] - min_bt_distance[i]) / bt_range : 0.0;
+    double tmp_prob_avg = 0.7 * tmp_prob_df + 0.3 * tmp_prob_bt;
+    if (tmp_prob_avg <= 0.0)
+    {
+      prob_avg = 0.0;
+      break;
+    }
+    else if (tmp_prob_avg > 1.0)
+      tmp_prob_avg = 1.0;
+    prob_avg += (weight / tmp_prob_avg);
+    weight_sum += weight;
   }
-  // if (target_count > 0 && tmp_dist > 0.0)
-  //   cur_distance = (double)target_count / tmp_dist;
-  // else
-  //   cur_distance = -1.0;
+  if (prob_avg > 0.0)
+    prob_avg = weight_sum / prob_avg;
 
-  // /* FGo: debug */
-  // fprintf(fgo_file_handler, "Current Distance: %.4f\n", cur_distance);
+  seed_dist.prob[id] = (prob_avg + seed_dist.prob_trans[id]) / 2.0;
+  seed_dist.prob_epoch[id] = dist_extreme_epoch;
 
-#endif // AFLGO_IMPL
+  return seed_dist.prob[id];
+}
 
-#else
+/* FGo: get the cooling temperature at a given time. It only depends on the
+   elapsed seconds, so it is computed again once per second at most. */
 
-  u32 *current = (u32 *)trace_bits;
-  u32 *virgin = (u32 *)virgin_map;
+static double get_cooling_temperature(u64 cur_ms)
+{
 
-  u32 i = (MAP_SIZE >> 2);
+  static u64 last_t = (u64)-1;
+  static double last_T = 1.0;
 
-#if AFLGO_IMPL
+  u64 t = (cur_ms - start_time) / 1000;
 
-  /* Calculate distance of current input to targets */
+  if (t == last_t)
+    return last_T;
 
-  u32 *total_distance = (u32 *)(trace_bits + MAP_SIZE);
-  u32 *total_count = (u32 *)(trace_bits + MAP_SIZE + 4);
+  double progress_to_tx = ((double)t) / ((double)t_x * 60.0);
 
-  if (*total_count > 0)
+  switch (cooling_schedule)
   {
-    cur_distance = (double)(*total_distance) / (double)(*total_count);
-    else cur_distance = -1.0;
+  case SAN_EXP:
 
-#endif // AFLGO_IMPL
+    last_T = 1.0 / pow(20.0, progress_to_tx);
 
-#endif /* ^WORD_SIZE_64 */
+    break;
 
-  u8 ret = 0;
+  case SAN_LOG:
 
-  while (i--)
-  {
+    // alpha = 2 and exp(19/2) - 1 = 13358.7268297
+    last_T = 1.0 / (1.0 + 2.0 * log(1.0 + progress_to_tx * 13358.7268297));
 
-    /* Optimize for (*current & *virgin) == 0 - i.e., no bits in current bitmap
-       that have not been already cleared from the virgin map - since this will
-       almost always be the case. */
+    break;
 
-    if (unlikely(*current) && unlikely(*current & *virgin))
-    {
+  case SAN_LIN:
 
-      if (likely(ret < 2))
-      {
+    last_T = 1.0 / (1.0 + 19.0 * progress_to_tx);
 
-        u8 *cur = (u8 *)current;
-        u8 *vir = (u8 *)virgin;
+    break;
 
-        /* Looks like we have not found any new bytes yet; see if any non-zero
-           bytes in current[] are pristine in virgin[]. */
+  case SAN_QUAD:
 
-#ifdef WORD_SIZE_64
+    last_T = 1.0 / (1.0 + 19.0 * pow(progress_to_tx, 2));
 
-        if ((cur[0] && vir[0] == 0xff) || (cur[1] && vir[1] == 0xff) ||
-            (cur[2] && vir[2] == 0xff) || (cur[3] && vir[3] == 0xff) ||
-            (cur[4] && vir[4] == 0xff) || (cur[5] && vir[5] == 0xff) ||
-            (cur[6] && vir[6] == 0xff) || (cur[7] && vir[7] == 0xff))
-          ret = 2;
-        else
-          ret = 1;
+    break;
 
-#else
+  default:
+    PFATAL("Unkown Power Schedule for Directed Fuzzing");
+  }
 
-          if ((cur[0] && vir[0] == 0xff) || (cur[1] && vir[1] == 0xff) ||
-              (cur[2] && vir[2] == 0xff) || (cur[3] && vir[3] == 0xff))
-            ret = 2;
-          else
-            ret = 1;
+  last_t = t;
+  return last_T;
+}
 
-#endif /* ^WORD_SIZE_64 */
-      }
+/* FGo: key of a seed for distance-prioritized scheduling. Seeds without
+   distances come after all the others. */
 
-      *virgin &= ~*current;
-    }
+static double dist_sched_key(struct queue_entry *q)
+{
 
-    current++;
-    virgin++;
-  }
+  double key = seed_df_distance(q)[0] > 0 ? get_seed_dist_prob(q) : 1.0;
 
-  if (ret && virgin_map == virgin_bits)
-    bitmap_changed = 1;
+  if (q->retired)
+    return HUGE_VAL;
 
-  return ret;
+  return key + q->sched_picks * DIST_SCHED_PICK_PENALTY;
 }
 
-/* Count the number of bits set in the provided bitmap. Used for the status
-   screen several times every second, does not have to be fast. */
-
-static u32 count_bits(u8 *mem)
+static void dist_heap_sift_up(u32 i)
 {
 
-  u32 *ptr = (u32 *)mem;
-  u32 i = (MAP_SIZE >> 2);
-  u32 ret = 0;
+  struct dist_heap_node node = dist_heap[i];
 
-  while (i--)
+  while (i)
   {
+    u32 parent = (i - 1) / 2;
+    if (dist_heap[parent].key <= node.key)
+      break;
+    dist_heap[i] = dist_heap[parent];
+    i = parent;
+  }
 
-    u32 v = *(ptr++);
+  dist_heap[i] = node;
+}
 
-    /* This gets called on the inverse, virgin bitmap; optimize for sparse
-       data. */
+static void dist_heap_sift_down(u32 i)
+{
 
-    if (v == 0xffffffff)
-    {
-      ret += 32;
-      continue;
-    }
+  struct dist_heap_node node = dist_heap[i];
 
-    v -= ((v >> 1) & 0x55555555);
-    v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
-    ret += (((v + (v >> 4)) & 0xF0F0F0F) * 0x01010101) >> 24;
+  while (2 * i + 1 < dist_heap_len)
+  {
+    u32 child = 2 * i + 1;
+    if (child + 1 < dist_heap_len && dist_heap[child + 1].key < dist_heap[child].key)
+      child++;
+    if (node.key <= dist_heap[child].key)
+      break;
+    dist_heap[i] = dist_heap[child];
+    i = child;
   }
 
-  return ret;
+  dist_heap[i] = node;
 }
 
-#define FF(_b) (0xff << ((_b) << 3))
-
-/* Count the number of bytes set in the bitmap. Called fairly sporadically,
-   mostly to update the status screen or calibrate and examine confirmed
-   new paths. */
+/* FGo: add a new seed to the scheduler. */
 
-static u32 count_bytes(u8 *mem)
+static void dist_heap_push(struct queue_entry *q)
 {
 
-  u32 *ptr = (u32 *)mem;
-  u32 i = (MAP_SIZE >> 2);
-  u32 ret = 0;
-
-  while (i--)
+  if (dist_heap_len == dist_heap_size)
   {
-
-    u32 v = *(ptr++);
-
-    if (!v)
-      continue;
-    if (v & FF(0))
-      ret++;
-    if (v & FF(1))
-      ret++;
-    if (v & FF(2))
-      ret++;
-    if (v & FF(3))
-      ret++;
+    dist_heap_size = dist_heap_size ? dist_heap_size * 2 : 1024;
+    dist_heap = ck_realloc(dist_heap, dist_heap_size * sizeof(struct dist_heap_node));
   }
 
-  return ret;
+  dist_heap[dist_heap_len].q = q;
+  dist_heap[dist_heap_len].key = dist_sched_key(q);
+  dist_heap_sift_up(dist_heap_len++);
 }
 
-/* Count the number of non-255 bytes set in the bitmap. Used strictly for the
-   status screen, several calls per second or so. */
+/* FGo: recompute all the keys after the min/max distances changed. */
 
-static u32 count_non_255_bytes(u8 *mem)
+static void dist_heap_rebuild(void)
 {
 
-  u32 *ptr = (u32 *)mem;
-  u32 i = (MAP_SIZE >> 2);
-  u32 ret = 0;
+  for (u32 i = 0; i < dist_heap_len; ++i)
+    dist_heap[i].key = dist_sched_key(dist_heap[i].q);
 
-  while (i--)
-  {
+  for (u32 i = dist_heap_len / 2; i > 0; --i)
+    dist_heap_sift_down(i - 1);
 
-    u32 v = *(ptr++);
+  dist_heap_epoch = dist_extreme_epoch;
+}
 
-    /* This is called on the virgin bitmap, so optimize for the most likely
-       case. */
+/* FGo: pick the next seed to fuzz. Most picks take the seed with the lowest
+   key, whose key then grows so that the others get their turn; the rest
+   walk the queue in order, so that far seeds are still explored. */
 
-    if (v == 0xffffffff)
-      continue;
-    if ((v & FF(0)) != FF(0))
-      ret++;
-    if ((v & FF(1)) != FF(1))
-      ret++;
-    if ((v & FF(2)) != FF(2))
-      ret++;
-    if ((v & FF(3)) != FF(3))
-      ret++;
+static struct queue_entry *dist_sched_next(void)
+{
+
+  struct queue_entry *q;
+
+  if (!dist_heap_len || UR(100) < dist_sched_explore)
+  {
+    dist_sched_rr = dist_sched_rr && dist_sched_rr->next ? dist_sched_rr->next : queue;
+    dist_sched_picked = 0;
+    return dist_sched_rr;
   }
 
-  return ret;
+  if (dist_heap_epoch != dist_extreme_epoch)
+    dist_heap_rebuild();
+
+  q = dist_heap[0].q;
+  q->sched_picks++;
+  dist_heap[0].key = dist_sched_key(q);
+  dist_heap_sift_down(0);
+
+  dist_sched_picked = 1;
+  return q;
 }
 
-/* Destructively simplify trace by eliminating hit count information
-   and replacing it with 0x80 or 0x01 depending on whether the tuple
-   is hit or not. Called on every new crash or timeout, should be
-   reasonably fast. */
+/* FGo: compare seeds by the directed part of their energy, for sorting.
+   get_seed_dist_prob() guards its zero ranges, but qsort() needs a total
+   order whatever it returns, so a NaN still ranks as the farthest. */
 
-static const u8 simplify_lookup[256] = {
+static int compare_seed_dist_prob(const void *a, const void *b)
+{
 
-    [0] = 1,
-    [1 ... 255] = 128
+  double prob_a = get_seed_dist_prob(*(struct queue_entry **)a);
+  double prob_b = get_seed_dist_prob(*(struct queue_entry **)b);
 
-};
+  if (isnan(prob_a) || isnan(prob_b))
+    return !!isnan(prob_a) - !!isnan(prob_b);
 
-#ifdef WORD_SIZE_64
+  return prob_a < prob_b ? -1 : prob_a > prob_b;
+}
 
-static void simplify_trace(u64 *mem)
+/* FGo: once in exploitation, retire some of the seeds that are far from
+   every target, so that the queue stops growing with irrelevant paths.
+   The farther a seed ranks, the more likely it gets retired. Favored seeds,
+   seeds not fuzzed yet and the current seed are spared. Retired seeds stay
+   in the queue and on disk, but are never fuzzed or spliced again. */
+
+static void prune_far_seeds(void)
 {
 
-  u32 i = MAP_SIZE >> 3;
+  struct queue_entry *q, **live;
+  u32 live_cnt = 0, retired_cnt = 0;
 
-  while (i--)
-  {
+  if (!dist_prune || get_cur_time() - start_time < (u64)t_x * 60 * 1000)
+    return;
 
-    /* Optimize for sparse bitmaps. */
+  live = ck_alloc(queued_paths * sizeof(struct queue_entry *));
 
-    if (unlikely(*mem))
-    {
+  for (q = queue; q; q = q->next)
+    if (!q->retired && seed_df_distance(q)[0] > 0)
+      live[live_cnt++] = q;
 
-      u8 *mem8 = (u8 *)mem;
+  qsort(live, live_cnt, sizeof(struct queue_entry *), compare_seed_dist_prob);
 
-      mem8[0] = simplify_lookup[mem8[0]];
-      mem8[1] = simplify_lookup[mem8[1]];
-      mem8[2] = simplify_lookup[mem8[2]];
-      mem8[3] = simplify_lookup[mem8[3]];
-      mem8[4] = simplify_lookup[mem8[4]];
-      mem8[5] = simplify_lookup[mem8[5]];
-      mem8[6] = simplify_lookup[mem8[6]];
-      mem8[7] = simplify_lookup[mem8[7]];
-    }
-    else
-      *mem = 0x0101010101010101ULL;
+  for (u32 i = 0; live_cnt > 1 && i < live_cnt; ++i)
+  {
+    u32 *tr = seed_tr_distance(live[i]);
+    double rank = (double)i / (live_cnt - 1);
+    u32 j;
 
-    mem++;
+    q = live[i];
+    if (q->favored || !q->was_fuzzed || q == queue_cur)
+      continue;
+
+    for (j = 0; j < target_info.target_count; ++j)
+      if (helper_get_quantile(&target_info, j, tr[j]) < DIST_PRUNE_QUANTILE)
+        break;
+    if (j < target_info.target_count)
+      continue;
+
+    if (UR(10000) < pow(2.0, DIST_PRUNE_STEEPNESS * (rank - 1.0)) * 10000)
+    {
+      q->retired = 1;
+      retired_cnt++;
+    }
   }
-}
 
-#else
+  ck_free(live);
 
-  static void simplify_trace(u32 * mem)
+  if (retired_cnt)
   {
+    queued_retired += retired_cnt;
+    score_changed = 1;
+    if (dist_sched)
+      dist_heap_rebuild();
+  }
+}
 
-    u32 i = MAP_SIZE >> 2;
+#endif // AFLGO_IMPL
 
-    while (i--)
-    {
+/* Append new test case to the queue. */
 
-      /* Optimize for sparse bitmaps. */
+static void add_to_queue(u8 *fname, u32 len, u8 passed_det)
+{
 
-      if (unlikely(*mem))
-      {
+  struct queue_entry *q = ck_alloc(sizeof(struct queue_entry));
 
-        u8 *mem8 = (u8 *)mem;
+  q->fname = fname;
+  q->len = len;
+  q->depth = cur_depth + 1;
+  q->passed_det = passed_det;
 
-        mem8[0] = simplify_lookup[mem8[0]];
-        mem8[1] = simplify_lookup[mem8[1]];
-        mem8[2] = simplify_lookup[mem8[2]];
-        mem8[3] = simplify_lookup[mem8[3]];
-      }
-      else
-        *mem = 0x01010101;
+#if AFLGO_IMPL
 
-      mem++;
-    }
-  }
+  // q->distance = cur_distance;
 
-#endif /* ^WORD_SIZE_64 */
+  // if (cur_distance > 0)
+  // {
 
-/* Destructively classify execution counts in a trace. This is used as a
-   preprocessing step for any newly acquired traces. Called on every exec,
-   must be fast. */
+  //   if (max_distance <= 0)
+  //   {
+  //     max_distance = cur_distance;
+  //     min_distance = cur_distance;
+  //   }
+  //   if (cur_distance > max_distance)
+  //     max_distance = cur_distance;
+  //   if (cur_distance < min_distance)
+  //     min_distance = cur_distance;
+  // }
 
-static const u8 count_class_lookup8[256] = {
+  /* FGo */
+  q->dist_id = alloc_seed_dist_row();
+  set_seed_distances(q);
 
-    [0] = 0,
-    [1] = 1,
-    [2] = 2,
-    [3] = 4,
-    [4 ... 7] = 8,
-    [8 ... 15] = 16,
-    [16 ... 31] = 32,
-    [32 ... 127] = 64,
-    [128 ... 255] = 128
+  if (dist_sched)
+    dist_heap_push(q);
 
-};
+#endif // AFLGO_IMPL
 
-static u16 count_class_lookup16[65536];
+  if (q->depth > max_depth)
+    max_depth = q->depth;
 
-EXP_ST void init_count_class16(void)
-{
+  if (queue_top)
+  {
 
-  u32 b1, b2;
+    queue_top->next = q;
+    queue_top = q;
+  }
+  else
+    q_prev100 = queue = queue_top = q;
 
-  for (b1 = 0; b1 < 256; b1++)
-    for (b2 = 0; b2 < 256; b2++)
-      count_class_lookup16[(b1 << 8) + b2] =
-          (count_class_lookup8[b1] << 8) |
-          count_class_lookup8[b2];
-}
+  queued_paths++;
+  pending_not_fuzzed++;
 
-#ifdef WORD_SIZE_64
+  cycles_wo_finds = 0;
 
-static inline void classify_counts(u64 *mem)
-{
+  if (!(queued_paths % 100))
+  {
 
-  u32 i = MAP_SIZE >> 3;
+    q_prev100->next_100 = q;
+    q_prev100 = q;
+  }
 
-  while (i--)
-  {
+  last_path_time = get_cur_time();
+}
 
-    /* Optimize for sparse bitmaps. */
+/* Destroy the entire queue. */
 
-    if (unlikely(*mem))
-    {
+EXP_ST void destroy_queue(void)
+{
 
-      u16 *mem16 = (u16 *)mem;
+  struct queue_entry *q = queue, *n;
 
-      mem16[0] = count_class_lookup16[mem16[0]];
-      mem16[1] = count_class_lookup16[mem16[1]];
-      mem16[2] = count_class_lookup16[mem16[2]];
-      mem16[3] = count_class_lookup16[mem16[3]];
-    }
+  while (q)
+  {
 
-    mem++;
+    n = q->next;
+    ck_free(q->fname);
+    ck_free(q->trace_mini);
+#if AFLGO_IMPL
+    ck_free(q->dist_pos);
+#endif // AFLGO_IMPL
+    ck_free(q);
+    q = n;
   }
 }
 
-#else
+/* Write bitmap to file. The bitmap is useful mostly for the secret
+   -B option, to focus a separate fuzzing session on a particular
+   interesting input without rediscovering all the others. */
 
-  static inline void classify_counts(u32 * mem)
-  {
+EXP_ST void write_bitmap(void)
+{
 
-    u32 i = MAP_SIZE >> 2;
+  u8 *fname;
+  s32 fd;
 
-    while (i--)
-    {
+  if (!bitmap_changed)
+    return;
+  bitmap_changed = 0;
 
-      /* Optimize for sparse bitmaps. */
+  fname = alloc_printf("%s/fuzz_bitmap", out_dir);
+  fd = open(fname, O_WRONLY | O_CREAT | O_TRUNC, 0600);
 
-      if (unlikely(*mem))
-      {
+  if (fd < 0)
+    PFATAL("Unable to open '%s'", fname);
 
-        u16 *mem16 = (u16 *)mem;
+  ck_write(fd, virgin_bits, MAP_SIZE, fname);
 
-        mem16[0] = count_class_lookup16[mem16[0]];
-        mem16[1] = count_class_lookup16[mem16[1]];
-      }
+  close(fd);
+  ck_free(fname);
+}
 
-      mem++;
-    }
-  }
+/* Read bitmap from file. This is for the -B option again. */
 
-#endif /* ^WORD_SIZE_64 */
+EXP_ST void read_bitmap(u8 *fname)
+{
 
-/* Get rid of shared memory (atexit handler). */
+  s32 fd = open(fname, O_RDONLY);
 
-static void remove_shm(void)
-{
+  if (fd < 0)
+    PFATAL("Unable to open '%s'", fname);
 
-  shmctl(shm_id, IPC_RMID, NULL);
+  ck_read(fd, virgin_bits, MAP_SIZE, fname);
+
+  close(fd);
 }
 
-/* Compact trace bytes into a smaller bitmap. We effectively just drop the
-   count information here. This is called only sporadically, for some
-   new paths. */
+/* Check if the current execution path brings anything new to the table.
+   Update virgin bits to reflect the finds. Returns 1 if the only change is
+   the hit-count for a particular tuple; 2 if there are new tuples seen.
+   Updates the map, so subsequent calls will always return 0.
 
-static void minimize_bits(u8 *dst, u8 *src)
+   This function is called after every exec() on a fairly large buffer, so
+   it needs to be fast. We do this in 32-bit and 64-bit flavors. */
+
+static inline u8 has_new_bits(u8 *virgin_map)
 {
 
-  u32 i = 0;
+#ifdef WORD_SIZE_64
 
-  while (i < MAP_SIZE)
-  {
+  u64 *current = (u64 *)trace_bits;
+  u64 *virgin = (u64 *)virgin_map;
 
-    if (*(src++))
-      dst[i >> 3] |= 1 << (i & 7);
-    i++;
-  }
-}
+  u32 i = (MAP_SIZE >> 3);
 
-/* When we bump into a new path, we call this to see if the path appears
-   more "favorable" than any of the existing ones. The purpose of the
-   "favorables" is to have a minimal set of paths that trigger all the bits
-   seen in the bitmap so far, and focus on fuzzing them at the expense of
-   the rest.
+#else
 
-   The first step of the process is to maintain a list of top_rated[] entries
-   for every byte in the bitmap. We win that slot if there is no previous
-   contender, or if the contender has a more favorable speed x size factor. */
+  u32 *current = (u32 *)trace_bits;
+  u32 *virgin = (u32 *)virgin_map;
 
-static void update_bitmap_score(struct queue_entry *q)
-{
+  u32 i = (MAP_SIZE >> 2);
 
-  u32 i;
-  u64 fav_factor = q->exec_us * q->len;
+#endif /* ^WORD_SIZE_64 */
 
-  /* For every byte set in trace_bits[], see if there is a previous winner,
-     and how it compares to us. */
+  u8 ret = 0;
 
-  for (i = 0; i < MAP_SIZE; i++)
+  while (i--)
+  {
 
-    if (trace_bits[i])
+    /* Optimize for (*current & *virgin) == 0 - i.e., no bits in current bitmap
+       that have not been already cleared from the virgin map - since this will
+       almost always be the case. */
+
+    if (unlikely(*current) && unlikely(*current & *virgin))
     {
 
-      if (top_rated[i])
+      if (likely(ret < 2))
       {
 
-        /* Faster-executing or smaller test cases are favored. */
+        u8 *cur = (u8 *)current;
+        u8 *vir = (u8 *)virgin;
 
-        if (fav_factor > top_rated[i]->exec_us * top_rated[i]->len)
-          continue;
+        /* Looks like we have not found any new bytes yet; see if any non-zero
+           bytes in current[] are pristine in virgin[]. */
 
-        /* Looks like we're going to win. Decrease ref count for the
-           previous winner, discard its trace_bits[] if necessary. */
+#ifdef WORD_SIZE_64
 
-        if (!--top_rated[i]->tc_ref)
-        {
-          ck_free(top_rated[i]->trace_mini);
-          top_rated[i]->trace_mini = 0;
-        }
-      }
+        if ((cur[0] && vir[0] == 0xff) || (cur[1] && vir[1] == 0xff) ||
+            (cur[2] && vir[2] == 0xff) || (cur[3] && vir[3] == 0xff) ||
+            (cur[4] && vir[4] == 0xff) || (cur[5] && vir[5] == 0xff) ||
+            (cur[6] && vir[6] == 0xff) || (cur[7] && vir[7] == 0xff))
+          ret = 2;
+        else
+          ret = 1;
 
-      /* Insert ourselves as the new winner. */
+#else
 
-      top_rated[i] = q;
-      q->tc_ref++;
+          if ((cur[0] && vir[0] == 0xff) || (cur[1] && vir[1] == 0xff) ||
+              (cur[2] && vir[2] == 0xff) || (cur[3] && vir[3] == 0xff))
+            ret = 2;
+          else
+            ret = 1;
 
-      if (!q->trace_mini)
-      {
-        q->trace_mini = ck_alloc(MAP_SIZE >> 3);
-        minimize_bits(q->trace_mini, trace_bits);
+#endif /* ^WORD_SIZE_64 */
       }
 
-      score_changed = 1;
+      *virgin &= ~*current;
     }
-}
 
-/* The second part of the mechanism discussed above is a routine that
-   goes over top_rated[] entries, and then sequentially grabs winners for
-   previously-unseen bytes (temp_v) and marks them as favored, at least
-   until the next run. The favored entries are given more air time during
-   all fuzzing steps. */
+    current++;
+    virgin++;
+  }
 
-static void cull_queue(void)
-{
+  if (ret && virgin_map == virgin_bits)
+    bitmap_changed = 1;
+
+  return ret;
+}
+
+/* Count the number of bits set in the provided bitmap. Used for the status
+   screen several times every second, does not have to be fast. */
+
+static u32 count_bits(u8 *mem)
+{
+
+  u32 *ptr = (u32 *)mem;
+  u32 i = (MAP_SIZE >> 2);
+  u32 ret = 0;
+
+  while (i--)
+  {
+
+    u32 v = *(ptr++);
+
+    /* This gets called on the inverse, virgin bitmap; optimize for sparse
+       data. */
+
+    if (v == 0xffffffff)
+    {
+      ret += 32;
+      continue;
+    }
+
+    v -= ((v >> 1) & 0x55555555);
+    v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
+    ret += (((v + (v >> 4)) & 0xF0F0F0F) * 0x01010101) >> 24;
+  }
+
+  return ret;
+}
+
+#define FF(_b) (0xff << ((_b) << 3))
+
+/* Count the number of bytes set in the bitmap. Called fairly sporadically,
+   mostly to update the status screen or calibrate and examine confirmed
+   new paths. */
+
+static u32 count_bytes(u8 *mem)
+{
+
+  u32 *ptr = (u32 *)mem;
+  u32 i = (MAP_SIZE >> 2);
+  u32 ret = 0;
+
+  while (i--)
+  {
+
+    u32 v = *(ptr++);
+
+    if (!v)
+      continue;
+    if (v & FF(0))
+      ret++;
+    if (v & FF(1))
+      ret++;
+    if (v & FF(2))
+      ret++;
+    if (v & FF(3))
+      ret++;
+  }
+
+  return ret;
+}
+
+/* Count the number of non-255 bytes set in the bitmap. Used strictly for the
+   status screen, several calls per second or so. */
+
+static u32 count_non_255_bytes(u8 *mem)
+{
+
+  u32 *ptr = (u32 *)mem;
+  u32 i = (MAP_SIZE >> 2);
+  u32 ret = 0;
+
+  while (i--)
+  {
+
+    u32 v = *(ptr++);
+
+    /* This is called on the virgin bitmap, so optimize for the most likely
+       case. */
+
+    if (v == 0xffffffff)
+      continue;
+    if ((v & FF(0)) != FF(0))
+      ret++;
+    if ((v & FF(1)) != FF(1))
+      ret++;
+    if ((v & FF(2)) != FF(2))
+      ret++;
+    if ((v & FF(3)) != FF(3))
+      ret++;
+  }
+
+  return ret;
+}
+
+/* Destructively simplify trace by eliminating hit count information
+   and replacing it with 0x80 or 0x01 depending on whether the tuple
+   is hit or not. Called on every new crash or timeout, should be
+   reasonably fast. */
+
+static const u8 simplify_lookup[256] = {
+
+    [0] = 1,
+    [1 ... 255] = 128
+
+};
+
+#ifdef WORD_SIZE_64
+
+static void simplify_trace(u64 *mem)
+{
+
+  u32 i = MAP_SIZE >> 3;
+
+  while (i--)
+  {
+
+    /* Optimize for sparse bitmaps. */
+
+    if (unlikely(*mem))
+    {
+
+      u8 *mem8 = (u8 *)mem;
+
+      mem8[0] = simplify_lookup[mem8[0]];
+      mem8[1] = simplify_lookup[mem8[1]];
+      mem8[2] = simplify_lookup[mem8[2]];
+      mem8[3] = simplify_lookup[mem8[3]];
+      mem8[4] = simplify_lookup[mem8[4]];
+      mem8[5] = simplify_lookup[mem8[5]];
+      mem8[6] = simplify_lookup[mem8[6]];
+      mem8[7] = simplify_lookup[mem8[7]];
+    }
+    else
+      *mem = 0x0101010101010101ULL;
+
+    mem++;
+  }
+}
+
+#else
+
+  static void simplify_trace(u32 * mem)
+  {
+
+    u32 i = MAP_SIZE >> 2;
+
+    while (i--)
+    {
+
+      /* Optimize for sparse bitmaps. */
+
+      if (unlikely(*mem))
+      {
+
+        u8 *mem8 = (u8 *)mem;
+
+        mem8[0] = simplify_lookup[mem8[0]];
+        mem8[1] = simplify_lookup[mem8[1]];
+        mem8[2] = simplify_lookup[mem8[2]];
+        mem8[3] = simplify_lookup[mem8[3]];
+      }
+      else
+        *mem = 0x01010101;
+
+      mem++;
+    }
+  }
+
+#endif /* ^WORD_SIZE_64 */
+
+/* Destructively classify execution counts in a trace. This is used as a
+   preprocessing step for any newly acquired traces. Called on every exec,
+   must be fast. */
+
+static const u8 count_class_lookup8[256] = {
+
+    [0] = 0,
+    [1] = 1,
+    [2] = 2,
+    [3] = 4,
+    [4 ... 7] = 8,
+    [8 ... 15] = 16,
+    [16 ... 31] = 32,
+    [32 ... 127] = 64,
+    [128 ... 255] = 128
+
+};
+
+static u16 count_class_lookup16[65536];
+
+EXP_ST void init_count_class16(void)
+{
+
+  u32 b1, b2;
+
+  for (b1 = 0; b1 < 256; b1++)
+    for (b2 = 0; b2 < 256; b2++)
+      count_class_lookup16[(b1 << 8) + b2] =
+          (count_class_lookup8[b1] << 8) |
+          count_class_lookup8[b2];
+}
+
+#ifdef WORD_SIZE_64
+
+static inline void classify_counts(u64 *mem)
+{
+
+  u32 i = MAP_SIZE >> 3;
+
+  while (i--)
+  {
+
+    /* Optimize for sparse bitmaps. */
+
+    if (unlikely(*mem))
+    {
+
+      u16 *mem16 = (u16 *)mem;
+
+      mem16[0] = count_class_lookup16[mem16[0]];
+      mem16[1] = count_class_lookup16[mem16[1]];
+      mem16[2] = count_class_lookup16[mem16[2]];
+      mem16[3] = count_class_lookup16[mem16[3]];
+    }
+
+    mem++;
+  }
+}
+
+#else
+
+  static inline void classify_counts(u32 * mem)
+  {
+
+    u32 i = MAP_SIZE >> 2;
+
+    while (i--)
+    {
+
+      /* Optimize for sparse bitmaps. */
+
+      if (unlikely(*mem))
+      {
+
+        u16 *mem16 = (u16 *)mem;
+
+        mem16[0] = count_class_lookup16[mem16[0]];
+        mem16[1] = count_class_lookup16[mem16[1]];
+      }
+
+      mem++;
+    }
+  }
+
+#endif /* ^WORD_SIZE_64 */
+
+/* Get rid of shared memory (atexit handler). */
+
+static void remove_shm(void)
+{
+
+  shmctl(shm_id, IPC_RMID, NULL);
+  if (shm_fuzz_id >= 0)
+    shmctl(shm_fuzz_id, IPC_RMID, NULL);
+#if AFLGO_IMPL
+  if (cmplog_shm_id >= 0)
+    shmctl(cmplog_shm_id, IPC_RMID, NULL);
+  if (san_shm_id >= 0)
+    shmctl(san_shm_id, IPC_RMID, NULL);
+#endif // AFLGO_IMPL
+}
+
+/* Compact trace bytes into a smaller bitmap. We effectively just drop the
+   count information here. This is called only sporadically, for some
+   new paths. */
+
+static void minimize_bits(u8 *dst, u8 *src)
+{
+
+  u32 i = 0;
+
+  while (i < MAP_SIZE)
+  {
+
+    if (*(src++))
+      dst[i >> 3] |= 1 << (i & 7);
+    i++;
+  }
+}
+
+/* When we bump into a new path, we call this to see if the path appears
+   more "favorable" than any of the existing ones. The purpose of the
+   "favorables" is to have a minimal set of paths that trigger all the bits
+   seen in the bitmap so far, and focus on fuzzing them at the expense of
+   the rest.
+
+   The first step of the process is to maintain a list of top_rated[] entries
+   for every byte in the bitmap. We win that slot if there is no previous
+   contender, or if the contender has a more favorable speed x size factor. */
+
+static void update_bitmap_score(struct queue_entry *q)
+{
+
+  u32 i;
+  u64 fav_factor = q->exec_us * q->len;
+
+#if AFLGO_IMPL
+  double reach_factor = reach_cov ? fav_factor * (REACH_FAV_BIAS + get_seed_dist_prob(q)) : 0;
+#endif // AFLGO_IMPL
+
+  /* For every byte set in trace_bits[], see if there is a previous winner,
+     and how it compares to us. */
+
+  for (i = 0; i < MAP_SIZE; i++)
+
+    if (trace_bits[i])
+    {
+
+#if AFLGO_IMPL
+      u8 reaching = reach_cov && (reach_mask[i >> 3] & (1 << (i & 7)));
+
+      /* FGo: keep track of the edges reaching a target seen so far, for
+         has_new_reach_bits(). */
+
+      if (reaching && !(reach_seen[i >> 3] & (1 << (i & 7))))
+      {
+        reach_seen[i >> 3] |= 1 << (i & 7);
+        reach_edges_seen++;
+      }
+#endif // AFLGO_IMPL
+
+      if (top_rated[i])
+      {
+
+        /* Faster-executing or smaller test cases are favored. */
+
+#if AFLGO_IMPL
+        /* FGo: on edges reaching a target, closer ones too. */
+
+        if (reaching)
+        {
+          struct queue_entry *t = top_rated[i];
+
+          if (reach_factor > t->exec_us * t->len * (REACH_FAV_BIAS + get_seed_dist_prob(t)) &&
+              !t->retired)
+            continue;
+        }
+        else if (fav_factor > top_rated[i]->exec_us * top_rated[i]->len && !top_rated[i]->retired)
+          continue;
+#else
+        if (fav_factor > top_rated[i]->exec_us * top_rated[i]->len)
+          continue;
+#endif // AFLGO_IMPL
+
+        /* Looks like we're going to win. Decrease ref count for the
+           previous winner, discard its trace_bits[] if necessary. */
+
+        if (!--top_rated[i]->tc_ref)
+        {
+          ck_free(top_rated[i]->trace_mini);
+          top_rated[i]->trace_mini = 0;
+        }
+      }
+
+      /* Insert ourselves as the new winner. */
+
+      top_rated[i] = q;
+      q->tc_ref++;
+
+      if (!q->trace_mini)
+      {
+        q->trace_mini = ck_alloc(MAP_SIZE >> 3);
+        minimize_bits(q->trace_mini, trace_bits);
+      }
+
+      score_changed = 1;
+    }
+}
+
+/* The second part of the mechanism discussed above is a routine that
+   goes over top_rated[] entries, and then sequentially grabs winners for
+   previously-unseen bytes (temp_v) and marks them as favored, at least
+   until the next run. The favored entries are given more air time during
+   all fuzzing steps. */
+
+static void cull_queue(void)
+{
 
   struct queue_entry *q;
   static u8 temp_v[MAP_SIZE >> 3];
@@ -1576,8 +2422,45 @@ static void cull_queue(void)
   /* Let's see if anything in the bitmap isn't captured in temp_v.
      If yes, and if it has a top_rated[] contender, let's use it. */
 
+#if AFLGO_IMPL
+
+  /* FGo: with -E, the edges reaching a target are covered first, so that
+     their winners also take the other edges they hit, and only the rest of
+     the bitmap is left to seeds off the way to the targets. */
+
+  favored_reach = 0;
+
+  if (reach_cov)
+  {
+
+    for (i = 0; i < MAP_SIZE; i++)
+      if ((reach_mask[i >> 3] & (1 << (i & 7))) && top_rated[i] &&
+          !top_rated[i]->retired && (temp_v[i >> 3] & (1 << (i & 7))))
+      {
+
+        u32 j = MAP_SIZE >> 3;
+
+        while (j--)
+          if (top_rated[i]->trace_mini[j])
+            temp_v[j] &= ~top_rated[i]->trace_mini[j];
+
+        top_rated[i]->favored = 1;
+        queued_favored++;
+        favored_reach++;
+
+        if (!top_rated[i]->was_fuzzed)
+          pending_favored++;
+      }
+  }
+
+#endif // AFLGO_IMPL
+
   for (i = 0; i < MAP_SIZE; i++)
+#if AFLGO_IMPL
+    if (top_rated[i] && !top_rated[i]->retired && (temp_v[i >> 3] & (1 << (i & 7))))
+#else
     if (top_rated[i] && (temp_v[i >> 3] & (1 << (i & 7))))
+#endif // AFLGO_IMPL
     {
 
       u32 j = MAP_SIZE >> 3;
@@ -1619,7 +2502,7 @@ EXP_ST void setup_shm(void)
 
 #if AFLGO_IMPL
   /* Allocate 16 byte more for distance info */
-  shm_id = shmget(IPC_PRIVATE, MAP_SIZE + FGO_TARGET_MAX_COUNT * 40, IPC_CREAT | IPC_EXCL | 0600);
+  shm_id = shmget(IPC_PRIVATE, MAP_SIZE + FGO_TARGET_MAX_COUNT * FGO_DIST_SLOT_SIZE, IPC_CREAT | IPC_EXCL | 0600);
 #else
     shm_id = shmget(IPC_PRIVATE, MAP_SIZE, IPC_CREAT | IPC_EXCL | 0600);
 #endif // AFLGO_IMPL
@@ -1645,6 +2528,74 @@ EXP_ST void setup_shm(void)
 
   if (trace_bits == (void *)-1)
     PFATAL("shmat() failed");
+
+  /* Optionally deliver test cases through a second segment instead of
+     out_file. Whether it is actually used is negotiated with the runtime
+     in init_forkserver(). */
+
+  if (getenv("AFL_SHM_FUZZ") && !dumb_mode)
+  {
+
+    shm_fuzz_id = shmget(IPC_PRIVATE, MAX_FILE + 4, IPC_CREAT | IPC_EXCL | 0600);
+
+    if (shm_fuzz_id < 0)
+      PFATAL("shmget() failed");
+
+    shm_str = alloc_printf("%d", shm_fuzz_id);
+    setenv(SHM_FUZZ_ENV_VAR, shm_str, 1);
+    ck_free(shm_str);
+
+    shm_fuzz_buf = shmat(shm_fuzz_id, NULL, 0);
+
+    if (shm_fuzz_buf == (void *)-1)
+      PFATAL("shmat() failed");
+  }
+
+#if AFLGO_IMPL
+
+  /* FGo: comparison log table for the input-to-state stage. The runtime
+     only attaches it when the variable is set. */
+
+  if (cmplog_mode && !dumb_mode)
+  {
+
+    cmplog_shm_id = shmget(IPC_PRIVATE, sizeof(struct cmp_map), IPC_CREAT | IPC_EXCL | 0600);
+
+    if (cmplog_shm_id < 0)
+      PFATAL("shmget() failed");
+
+    shm_str = alloc_printf("%d", cmplog_shm_id);
+    setenv(CMPLOG_SHM_ENV_VAR, shm_str, 1);
+    ck_free(shm_str);
+
+    cmp_map = shmat(cmplog_shm_id, NULL, 0);
+
+    if (cmp_map == (void *)-1)
+      PFATAL("shmat() failed");
+  }
+
+  /* FGo: bitmap and distance region of the sanitized binary (-A). Its ID is
+     only passed to its fork server. */
+
+  if (san_path)
+  {
+
+    memset(virgin_san, 255, MAP_SIZE);
+    memset(virgin_san_crash, 255, MAP_SIZE);
+
+    san_shm_id = shmget(IPC_PRIVATE, MAP_SIZE + FGO_TARGET_MAX_COUNT * FGO_DIST_SLOT_SIZE,
+                        IPC_CREAT | IPC_EXCL | 0600);
+
+    if (san_shm_id < 0)
+      PFATAL("shmget() failed");
+
+    san_trace_bits = shmat(san_shm_id, NULL, 0);
+
+    if (san_trace_bits == (void *)-1)
+      PFATAL("shmat() failed");
+  }
+
+#endif // AFLGO_IMPL
 }
 
 /* Load postprocessor, if available. */
@@ -1811,6 +2762,9 @@ static void load_extras_file(u8 *fname, u32 *min_len, u32 *max_len,
   u8 buf[MAX_LINE];
   u8 *lptr;
   u32 cur_line = 0;
+#if AFLGO_IMPL
+  u8 *label;
+#endif // AFLGO_IMPL
 
   f = fopen(fname, "r");
 
@@ -1852,6 +2806,10 @@ static void load_extras_file(u8 *fname, u32 *min_len, u32 *max_len,
 
     /* Skip alphanumerics and dashes (label). */
 
+#if AFLGO_IMPL
+    label = lptr;
+#endif // AFLGO_IMPL
+
     while (isalnum(*lptr) || *lptr == '_')
       lptr++;
 
@@ -1934,6 +2892,16 @@ static void load_extras_file(u8 *fname, u32 *min_len, u32 *max_len,
 
     extras[extras_cnt].len = klen;
 
+#if AFLGO_IMPL
+
+    /* FGo: labels like dist_N give the distance of the code using the token,
+       as in the dictionaries written by the pass. */
+
+    if (!strncmp(label, "dist_", 5) && isdigit(label[5]))
+      extras[extras_cnt].dist = atoi(label + 5);
+
+#endif // AFLGO_IMPL
+
     if (extras[extras_cnt].len > MAX_DICT_FILE)
       FATAL("Keyword too big in line %u (%s, limit is %s)", cur_line,
             DMS(klen), DMS(MAX_DICT_FILE));
@@ -2054,6 +3022,122 @@ check_and_sort:
           MAX_DET_EXTRAS);
 }
 
+#if AFLGO_IMPL
+
+/* FGo: load the dictionaries the pass embedded into TARGET_DICT_SECTION of
+   every object linked into the binary, if any. Their tokens come from the
+   code near the targets, and the extras are then ordered by proximity in
+   sort_extras_by_dist(). They are saved to <out_dir>/target_dict first, to
+   be parsed as any dictionary and for reference. */
+
+static void load_target_dict(void)
+{
+
+  u32 min_len = MAX_DICT_FILE, max_len = 0, orig_cnt = extras_cnt, size = 0, i, j = 0;
+  u8 *dict = read_binary_section(TARGET_DICT_SECTION, &size), *fn;
+  s32 fd;
+
+  if (!dict)
+    return;
+
+  /* Zeros are padding between the objects */
+
+  for (i = 0; i < size; i++)
+    if (dict[i])
+      dict[j++] = dict[i];
+
+  size = j;
+
+  fn = alloc_printf("%s/target_dict", out_dir);
+
+  fd = open(fn, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0)
+    PFATAL("Unable to create '%s'", fn);
+
+  ck_write(fd, dict, size, fn);
+  close(fd);
+  ck_free(dict);
+
+  load_extras_file(fn, &min_len, &max_len, 0);
+  ck_free(fn);
+
+  if (extras_cnt > orig_cnt)
+  {
+    OKF("Loaded %u tokens near the targets, size range %s to %s.",
+        extras_cnt - orig_cnt, DMS(min_len), DMS(max_len));
+    extras_by_dist = 1;
+  }
+}
+
+/* Helpers for sort_extras_by_dist(). */
+
+static int compare_extras_data(const void *p1, const void *p2)
+{
+  struct extra_data *e1 = (struct extra_data *)p1,
+                    *e2 = (struct extra_data *)p2;
+  int ret;
+
+  if (e1->len != e2->len)
+    return e1->len - e2->len;
+
+  if ((ret = memcmp(e1->data, e2->data, e1->len)))
+    return ret;
+
+  return e1->dist - e2->dist;
+}
+
+static int compare_extras_dist(const void *p1, const void *p2)
+{
+  struct extra_data *e1 = (struct extra_data *)p1,
+                    *e2 = (struct extra_data *)p2;
+
+  if (e1->dist != e2->dist)
+    return e1->dist < e2->dist ? -1 : 1;
+
+  return e1->len - e2->len;
+}
+
+/* FGo: drop the duplicate tokens, keeping the nearest, and order extras[]
+   by proximity. Tokens of -x dictionaries without a dist_N label come
+   first. The deterministic stages then only use the MAX_DET_EXTRAS nearest
+   tokens, and havoc picks the nearer ones more often. */
+
+static void sort_extras_by_dist(void)
+{
+
+  u32 i, j = 0;
+
+  qsort(extras, extras_cnt, sizeof(struct extra_data), compare_extras_data);
+
+  for (i = 0; i < extras_cnt; i++)
+  {
+
+    if (j && extras[j - 1].len == extras[i].len &&
+        !memcmp(extras[j - 1].data, extras[i].data, extras[i].len))
+    {
+      ck_free(extras[i].data);
+      continue;
+    }
+
+    extras[j++] = extras[i];
+  }
+
+  extras_cnt = j;
+
+  qsort(extras, extras_cnt, sizeof(struct extra_data), compare_extras_dist);
+}
+
+/* FGo: index of an extra for havoc, biased towards the nearer ones when
+   extras[] is ordered by proximity. */
+
+#define UR_EXTRA() (extras_by_dist ? UR(UR(extras_cnt) + 1) : UR(extras_cnt))
+
+#else
+
+#define UR_EXTRA() UR(extras_cnt)
+
+#endif // AFLGO_IMPL
+
 /* Helper function for maybe_add_auto() */
 
 static inline u8 memcmp_nocase(u8 *m1, u8 *m2, u32 len)
@@ -2114,6 +3198,20 @@ static void maybe_add_auto(u8 *mem, u32 len)
      match. We optimize by exploiting the fact that extras[] are sorted
      by size. */
 
+#if AFLGO_IMPL
+
+  /* FGo: unless they are ordered by proximity. */
+
+  if (extras_by_dist)
+  {
+    for (i = 0; i < extras_cnt; i++)
+      if (extras[i].len == len && !memcmp_nocase(extras[i].data, mem, len))
+        return;
+  }
+  else
+  {
+#endif // AFLGO_IMPL
+
   for (i = 0; i < extras_cnt; i++)
     if (extras[i].len >= len)
       break;
@@ -2122,6 +3220,10 @@ static void maybe_add_auto(u8 *mem, u32 len)
     if (!memcmp_nocase(extras[i].data, mem, len))
       return;
 
+#if AFLGO_IMPL
+  }
+#endif // AFLGO_IMPL
+
   /* Last but not least, check a_extras[] for matches. There are no
      guarantees of a particular sort order. */
 
@@ -2436,6 +3538,32 @@ EXP_ST void init_forkserver(char **argv)
 
   if (rlen == 4)
   {
+
+    /* A runtime attached to the test case segment advertises how it can
+       consume it. The buffer mode needs a harness reading __afl_fuzz_ptr;
+       the stdin mode only works if the target isn't reading out_file. */
+
+    if ((status & FS_OPT_ENABLED) && shm_fuzz_buf)
+    {
+
+      u32 reply = status & FS_OPT_SHDMEM_FUZZ;
+
+      if (!out_file)
+        reply |= status & FS_OPT_SHDMEM_STDIN;
+
+      if (write(fsrv_ctl_fd, &reply, 4) != 4)
+        RPFATAL(-1, "Unable to reply to the fork server");
+
+      shm_fuzz_opts = reply;
+
+      if (shm_fuzz_opts & FS_OPT_SHDMEM_FUZZ)
+        OKF("Test cases are delivered through shared memory (harness buffer).");
+      else if (shm_fuzz_opts & FS_OPT_SHDMEM_STDIN)
+        OKF("Test cases are delivered through shared memory (stdin).");
+      else
+        WARNF("The target can't take test cases from shared memory, using files.");
+    }
+
     OKF("All right - fork server is up.");
     return;
   }
@@ -2594,13 +3722,10 @@ static u8 run_target(char **argv, u32 timeout)
      territory. */
 
 #if AFLGO_IMPL
-  memset(trace_bits, 0, MAP_SIZE + FGO_TARGET_MAX_COUNT * 40);
+  memset(trace_bits, 0, MAP_SIZE);
 
   // FGo
-  for (u32 i = 0; i < FGO_TARGET_MAX_COUNT; ++i)
-  {
-    *((u64 *)(trace_bits + MAP_SIZE + i * 40 + 32)) = INT32_MAX;
-  }
+  memcpy(trace_bits + MAP_SIZE, dist_region_template, dist_region_size);
 #else
     memset(trace_bits, 0, MAP_SIZE);
 #endif // AFLGO_IMPL
@@ -2709,6 +3834,14 @@ static u8 run_target(char **argv, u32 timeout)
       RPFATAL(res, "Unable to request new process from fork server (OOM?)");
     }
 
+    if (shm_fuzz_opts && (res = write(fsrv_ctl_fd, &shm_fuzz_len, 4)) != 4)
+    {
+
+      if (stop_soon)
+        return 0;
+      RPFATAL(res, "Unable to send the test case length to fork server");
+    }
+
     if ((res = read(fsrv_st_fd, &child_pid, 4)) != 4)
     {
 
@@ -2824,6 +3957,17 @@ static void write_to_testcase(void *mem, u32 len)
 
   s32 fd = out_fd;
 
+  if (shm_fuzz_opts)
+  {
+
+    if (len > MAX_FILE)
+      FATAL("Test case too big for the shared memory buffer");
+
+    memcpy(shm_fuzz_buf + 4, mem, len);
+    shm_fuzz_len = len;
+    return;
+  }
+
   if (out_file)
   {
 
@@ -2858,6 +4002,15 @@ static void write_with_gap(void *mem, u32 len, u32 skip_at, u32 skip_len)
   s32 fd = out_fd;
   u32 tail_len = len - skip_at - skip_len;
 
+  if (shm_fuzz_opts)
+  {
+
+    memcpy(shm_fuzz_buf + 4, mem, skip_at);
+    memcpy(shm_fuzz_buf + 4 + skip_at, mem + skip_at + skip_len, tail_len);
+    shm_fuzz_len = len - skip_len;
+    return;
+  }
+
   if (out_file)
   {
 
@@ -2991,21 +4144,12 @@ static u8 calibrate_case(char **argv, struct queue_entry *q, u8 *use_mem,
     //   }
     // }
 
-    if (q->df_distance[0] <= 0)
+    if (seed_df_distance(q)[0] <= 0)
     {
 
-      /* This calculates cur_distance */
-      has_new_bits(virgin_bits);
-
       /* FGo */
-      for (uint32_t i = 0; i < target_info.target_count; ++i)
-      {
-        q->df_distance[i] = cur_df_distance[i];
-        update_df_extreme_value(i);
-        q->bt_distance[i] = cur_bt_distance[i];
-        update_bt_extreme_value(i);
-        q->tr_distance[i] = cur_tr_distance[i];
-      }
+      decode_target_distances(trace_bits + MAP_SIZE);
+      set_seed_distances(q);
     }
 
 #endif // AFLGO_IMPL
@@ -3151,6 +4295,11 @@ static void perform_dry_run(char **argv)
     close(fd);
 
     res = calibrate_case(argv, q, use_mem, 0, 1);
+
+#if AFLGO_IMPL
+    index_queue_entry(q, use_mem);
+#endif // AFLGO_IMPL
+
     ck_free(use_mem);
 
     if (stop_soon)
@@ -3463,60 +4612,160 @@ static void pivot_inputs(void)
     if (q->passed_det)
       mark_as_det_done(q);
 
-    q = q->next;
-    id++;
+    q = q->next;
+    id++;
+  }
+
+  if (in_place_resume)
+    nuke_resume_dir();
+}
+
+#ifndef SIMPLE_FILES
+
+/* Construct a file name for a new test case, capturing the operation
+   that led to its discovery. Uses a static buffer. */
+
+static u8 *describe_op(u8 hnb)
+{
+
+  static u8 ret[256];
+
+  if (syncing_party)
+  {
+
+    sprintf(ret, "sync:%s,src:%06u", syncing_party, syncing_case);
+  }
+  else
+  {
+
+    sprintf(ret, "src:%06u", current_entry);
+
+    if (splicing_with >= 0)
+      sprintf(ret + strlen(ret), "+%06u", splicing_with);
+
+    sprintf(ret + strlen(ret), ",op:%s", stage_short);
+
+    if (stage_cur_byte >= 0)
+    {
+
+      sprintf(ret + strlen(ret), ",pos:%u", stage_cur_byte);
+
+      if (stage_val_type != STAGE_VAL_NONE)
+        sprintf(ret + strlen(ret), ",val:%s%+d",
+                (stage_val_type == STAGE_VAL_BE) ? "be:" : "",
+                stage_cur_val);
+    }
+    else
+      sprintf(ret + strlen(ret), ",rep:%u", stage_cur_val);
+  }
+
+  if (hnb == 2)
+    strcat(ret, ",+cov");
+
+#if AFLGO_IMPL
+  if (hnb == 3)
+    strcat(ret, ",+dist");
+
+  if (hnb == 4)
+    strcat(ret, ",+cov,+tcov");
+
+  if (hnb == 5)
+    strcat(ret, ",+target");
+#endif // AFLGO_IMPL
+
+  return ret;
+}
+
+#endif /* !SIMPLE_FILES */
+
+#if AFLGO_IMPL
+
+/* FGo: check whether the last run, which has no new tuples, executed a
+   target not reached by any seed yet. Returns 5, which stands for this in
+   save_if_interesting() and describe_op(), or 0. This runs after nearly
+   every exec, so only the min slot of the targets not reached yet is read;
+   the full decode is left to the inputs that are saved. */
+
+static u8 has_new_target(void)
+{
+
+  if (targets_reached == target_info.target_count)
+    return 0;
+
+  for (u32 i = 0; i < target_info.target_count; ++i)
+  {
+    u64 *slot;
+
+    if (target_reached[i])
+      continue;
+
+    slot = (u64 *)(trace_bits + MAP_SIZE + i * FGO_DIST_SLOT_SIZE);
+    if (!slot[FGO_DIST_SLOT_MIN_OFFSET / 8])
+      return 5;
   }
 
-  if (in_place_resume)
-    nuke_resume_dir();
+  return 0;
 }
 
-#ifndef SIMPLE_FILES
-
-/* Construct a file name for a new test case, capturing the operation
-   that led to its discovery. Uses a static buffer. */
+/* FGo: check whether the last run got closer to some target than any seed
+   so far, by its transitional or DF distance. Such inputs are kept at most
+   DIST_NOVELTY_PER_MIN times a minute. Returns 3, which stands for this
+   in save_if_interesting() and describe_op(), or 0. */
 
-static u8 *describe_op(u8 hnb)
+static u8 has_new_distance(void)
 {
 
-  static u8 ret[256];
+  static u64 window_ms;
+  static u32 window_cnt;
 
-  if (syncing_party)
-  {
+  u64 cur_ms;
+  u32 i;
 
-    sprintf(ret, "sync:%s,src:%06u", syncing_party, syncing_case);
-  }
-  else
+  decode_target_distances(trace_bits + MAP_SIZE);
+
+  for (i = 0; i < target_info.target_count; ++i)
+    if (cur_tr_distance[i] < min_tr_distance[i] ||
+        (cur_df_distance[i] > 0 && cur_df_distance[i] < min_df_distance[i]))
+      break;
+
+  if (i == target_info.target_count)
+    return 0;
+
+  cur_ms = get_cur_time();
+
+  if (cur_ms - window_ms >= 60 * 1000)
   {
+    window_ms = cur_ms;
+    window_cnt = 0;
+  }
 
-    sprintf(ret, "src:%06u", current_entry);
+  if (window_cnt >= DIST_NOVELTY_PER_MIN)
+    return 0;
 
-    if (splicing_with >= 0)
-      sprintf(ret + strlen(ret), "+%06u", splicing_with);
+  window_cnt++;
+  queued_dist_novel++;
 
-    sprintf(ret + strlen(ret), ",op:%s", stage_short);
+  return 3;
+}
 
-    if (stage_cur_byte >= 0)
-    {
+/* FGo: check whether the last run, which has new tuples, has some on the
+   edges reaching a target not seen by any queued seed yet. reach_seen is
+   updated by update_bitmap_score() once the input is queued. Returns 4,
+   which stands for this in save_if_interesting() and describe_op(), or 2. */
 
-      sprintf(ret + strlen(ret), ",pos:%u", stage_cur_byte);
+static u8 has_new_reach_bits(void)
+{
 
-      if (stage_val_type != STAGE_VAL_NONE)
-        sprintf(ret + strlen(ret), ",val:%s%+d",
-                (stage_val_type == STAGE_VAL_BE) ? "be:" : "",
-                stage_cur_val);
-    }
-    else
-      sprintf(ret + strlen(ret), ",rep:%u", stage_cur_val);
-  }
+  u32 i;
 
-  if (hnb == 2)
-    strcat(ret, ",+cov");
+  for (i = 0; i < MAP_SIZE; i++)
+    if (trace_bits[i] && (reach_mask[i >> 3] & ~reach_seen[i >> 3] & (1 << (i & 7))))
+      return 4;
 
-  return ret;
+  return 2;
 }
 
-#endif /* !SIMPLE_FILES */
+#endif // AFLGO_IMPL
 
 /* Write a message accompanying the crash directory :-) */
 
@@ -3566,6 +4815,224 @@ static void write_crash_readme(void)
   fclose(f);
 }
 
+#if AFLGO_IMPL
+
+/* FGo: what the fork server of the sanitized binary does before execv():
+   take its own bitmap and none of the other segments, and drop the fds of
+   afl-fuzz. */
+
+static void san_child_setup(void)
+{
+
+  u8 *shm_str = alloc_printf("%d", san_shm_id);
+
+  setenv(SHM_ENV_VAR, shm_str, 1);
+  unsetenv(SHM_FUZZ_ENV_VAR);
+  unsetenv(CMPLOG_SHM_ENV_VAR);
+
+  close(out_dir_fd);
+  close(dev_urandom_fd);
+  close(fileno(plot_file));
+}
+
+/* FGo: spin up the fork server of the sanitized binary given with -A,
+   through the client shared with the other tools. There is no memory limit
+   since ASan reserves a lot of address space, and test cases always come
+   through out_file or stdin. */
+
+static void init_san_forkserver(void)
+{
+
+  ACTF("Spinning up the fork server of the sanitized binary...");
+
+  san_fsrv.target_path = san_path;
+  san_fsrv.argv = san_argv;
+  san_fsrv.trace_bits = san_trace_bits;
+  san_fsrv.in_fd = out_file ? dev_null_fd : out_fd;
+  san_fsrv.out_fd = dev_null_fd;
+  san_fsrv.child_setup = san_child_setup;
+
+  if (fsrv_start(&san_fsrv, exec_tmout * FORK_WAIT_MULT))
+  {
+    OKF("All right - the sanitized fork server is up.");
+    return;
+  }
+
+  if (san_fsrv.timed_out)
+    FATAL("Timeout while initializing the sanitized fork server");
+
+  if (WIFSIGNALED(san_fsrv.status))
+    FATAL("Sanitized fork server crashed with signal %d", WTERMSIG(san_fsrv.status));
+
+  if (*(u32 *)san_trace_bits == EXEC_FAIL_SIG)
+    FATAL("Unable to execute the sanitized binary ('%s')", san_path);
+
+  FATAL("Sanitized fork server handshake failed");
+}
+
+/* FGo: run a test case through the sanitized binary. Like run_target(), but
+   with SAN_TMOUT_MULT times the timeout, and without touching trace_bits or
+   the execution counters. */
+
+static u8 run_san_target(void *mem, u32 len)
+{
+
+  u32 shm_opts = shm_fuzz_opts;
+  int status = 0;
+
+  if (!san_fsrv.pid)
+    init_san_forkserver();
+
+  /* The sanitized binary always reads the test case from out_file or
+     stdin. */
+
+  shm_fuzz_opts = 0;
+  write_to_testcase(mem, len);
+  shm_fuzz_opts = shm_opts;
+
+  memset(san_trace_bits, 0, MAP_SIZE);
+  memcpy(san_trace_bits + MAP_SIZE, dist_region_template, dist_region_size);
+  MEM_BARRIER();
+
+  if (!fsrv_run(&san_fsrv, exec_tmout * SAN_TMOUT_MULT, &status))
+  {
+
+    if (stop_soon)
+      return FAULT_NONE;
+    RPFATAL(-1, "Unable to communicate with the sanitized fork server");
+  }
+
+  san_execs++;
+
+  MEM_BARRIER();
+
+#ifdef WORD_SIZE_64
+  classify_counts((u64 *)san_trace_bits);
+#else
+  classify_counts((u32 *)san_trace_bits);
+#endif /* ^WORD_SIZE_64 */
+
+  if (WIFSIGNALED(status) && !stop_soon)
+  {
+
+    kill_signal = WTERMSIG(status);
+
+    if (san_fsrv.timed_out && kill_signal == SIGKILL)
+      return FAULT_TMOUT;
+
+    return FAULT_CRASH;
+  }
+
+  if (WIFEXITED(status) && WEXITSTATUS(status) == MSAN_ERROR)
+  {
+    kill_signal = 0;
+    return FAULT_CRASH;
+  }
+
+  return FAULT_NONE;
+}
+
+/* FGo: replay the last test case through the sanitized binary (-A). Runs
+   that ended with fault FAULT_NONE are only replayed when they reached some
+   target (tr distance 0) on a path not replayed yet; the unique crashes and
+   hangs are always replayed. Replays are counted for every target reached,
+   with the time they took, and a crash of the sanitized binary alone is
+   saved to crashes/ and tagged san. */
+
+static void verify_sanitized(void *mem, u32 len, u8 fault)
+{
+
+  u8 reached[FGO_TARGET_MAX_COUNT];
+  u8 any = 0, san_fault, orig_signal = kill_signal, *orig_bits, *fn;
+  u64 start_ms, ms;
+  u32 i;
+  s32 fd;
+
+  for (i = 0; i < target_info.target_count; ++i)
+  {
+    u64 *slot = (u64 *)(trace_bits + MAP_SIZE + i * FGO_DIST_SLOT_SIZE);
+    reached[i] = !slot[FGO_DIST_SLOT_MIN_OFFSET / 8];
+    any |= reached[i];
+  }
+
+  if (fault == FAULT_NONE && (!any || !has_new_bits(virgin_san)))
+    return;
+
+  start_ms = get_cur_time();
+  san_fault = run_san_target(mem, len);
+  ms = get_cur_time() - start_ms;
+
+  san_time_ms += ms;
+
+  for (i = 0; i < target_info.target_count; ++i)
+  {
+    if (!reached[i])
+      continue;
+    target_san_execs[i]++;
+    target_san_ms[i] += ms;
+    if (san_fault == FAULT_CRASH)
+      target_san_crashes[i]++;
+  }
+
+  if (stop_soon || san_fault != FAULT_CRASH || fault == FAULT_CRASH ||
+      unique_crashes >= KEEP_UNIQUE_CRASH)
+    goto restore_signal;
+
+  /* Keep the crashes with new bits in the sanitized bitmap, which
+     has_new_bits() reads through trace_bits. */
+
+#ifdef WORD_SIZE_64
+  simplify_trace((u64 *)san_trace_bits);
+#else
+  simplify_trace((u32 *)san_trace_bits);
+#endif /* ^WORD_SIZE_64 */
+
+  orig_bits = trace_bits;
+  trace_bits = san_trace_bits;
+  any = has_new_bits(virgin_san_crash);
+  trace_bits = orig_bits;
+
+  if (!any)
+    goto restore_signal;
+
+  if (!unique_crashes)
+    write_crash_readme();
+
+#ifndef SIMPLE_FILES
+
+  fn = alloc_printf("%s/crashes/id:%06llu,%llu,sig:%02u,san,%s", out_dir,
+                    unique_crashes, get_cur_time() - start_time,
+                    kill_signal, describe_op(0));
+
+#else
+
+  fn = alloc_printf("%s/crashes/id_%06llu_%02u_san", out_dir, unique_crashes,
+                    kill_signal);
+
+#endif /* ^!SIMPLE_FILES */
+
+  total_crashes++;
+  unique_crashes++;
+  san_crashes++;
+
+  last_crash_time = get_cur_time();
+  last_crash_execs = total_execs;
+
+  fd = open(fn, O_WRONLY | O_CREAT | O_EXCL, 0600);
+  if (fd < 0)
+    PFATAL("Unable to create '%s'", fn);
+  ck_write(fd, mem, len, fn);
+  close(fd);
+
+  ck_free(fn);
+
+restore_signal:
+
+  kill_signal = orig_signal;
+}
+
+#endif // AFLGO_IMPL
+
 /* Check if the result of an execve() during routine fuzzing is interesting,
    save or queue the input test case for further analysis if so. Returns 1 if
    entry is saved, 0 otherwise. */
@@ -3578,6 +5045,11 @@ static u8 save_if_interesting(char **argv, void *mem, u32 len, u8 fault)
   s32 fd;
   u8 keeping = 0, res;
 
+#if AFLGO_IMPL
+  if (san_path && fault == FAULT_NONE)
+    verify_sanitized(mem, len, fault);
+#endif // AFLGO_IMPL
+
   if (fault == crash_mode)
   {
 
@@ -3586,11 +5058,27 @@ static u8 save_if_interesting(char **argv, void *mem, u32 len, u8 fault)
 
     if (!(hnb = has_new_bits(virgin_bits)))
     {
-      if (crash_mode)
-        total_crashes++;
-      return 0;
+#if AFLGO_IMPL
+
+      /* FGo: keep inputs reaching a target for the first time all the
+         same, so that the reach is recorded, and with -N, also inputs
+         getting closer to some target. */
+
+      if (!(hnb = has_new_target()) &&
+          (!dist_novelty || crash_mode || !(hnb = has_new_distance())))
+#endif // AFLGO_IMPL
+      {
+        if (crash_mode)
+          total_crashes++;
+        return 0;
+      }
     }
 
+#if AFLGO_IMPL
+    if (reach_cov && hnb == 2)
+      hnb = has_new_reach_bits();
+#endif // AFLGO_IMPL
+
 #ifndef SIMPLE_FILES
 
 #if AFLGO_IMPL
@@ -3608,9 +5096,20 @@ static u8 save_if_interesting(char **argv, void *mem, u32 len, u8 fault)
 
 #endif /* ^!SIMPLE_FILES */
 
+#if AFLGO_IMPL
+    decode_target_distances(trace_bits + MAP_SIZE);
+#endif // AFLGO_IMPL
+
     add_to_queue(fn, len, 0);
 
+#if AFLGO_IMPL
+    if (hnb == 4)
+      queued_reach_cov++;
+
+    if (hnb == 2 || hnb == 4)
+#else
     if (hnb == 2)
+#endif // AFLGO_IMPL
     {
       queue_top->has_new_cov = 1;
       queued_with_cov++;
@@ -3632,6 +5131,10 @@ static u8 save_if_interesting(char **argv, void *mem, u32 len, u8 fault)
     ck_write(fd, mem, len, fn);
     close(fd);
 
+#if AFLGO_IMPL
+    index_queue_entry(queue_top, mem);
+#endif // AFLGO_IMPL
+
     keeping = 1;
   }
 
@@ -3687,6 +5190,11 @@ static u8 save_if_interesting(char **argv, void *mem, u32 len, u8 fault)
         return keeping;
     }
 
+#if AFLGO_IMPL
+    if (san_path)
+      verify_sanitized(mem, len, FAULT_TMOUT);
+#endif // AFLGO_IMPL
+
 #ifndef SIMPLE_FILES
 
 #if AFLGO_IMPL
@@ -3737,6 +5245,11 @@ static u8 save_if_interesting(char **argv, void *mem, u32 len, u8 fault)
         return keeping;
     }
 
+#if AFLGO_IMPL
+    if (san_path)
+      verify_sanitized(mem, len, FAULT_CRASH);
+#endif // AFLGO_IMPL
+
     if (!unique_crashes)
       write_crash_readme();
 
@@ -3871,6 +5384,55 @@ static void find_timeout(void)
 
 /* Update stats file for unattended monitoring. */
 
+#if AFLGO_IMPL
+
+/* FGo: write the finds and execs of every stage, and the time spent, per
+   distance bucket, to <out_dir>/dist_buckets, so that the -D policy can be
+   checked. */
+
+static void write_bucket_stats(void)
+{
+
+  static const u8 *bucket_names[3] = {"near", "mid", "far"};
+  static const u8 *stage_names[STAGE_CMPLOG + 1] = {
+      "flip1", "flip2", "flip4", "flip8", "flip16", "flip32",
+      "arith8", "arith16", "arith32", "int8", "int16", "int32",
+      "ext_UO", "ext_UI", "ext_AO", "havoc", "splice", "dinfer", "its"};
+
+  u8 *fn = alloc_printf("%s/dist_buckets", out_dir);
+  s32 fd;
+  FILE *f;
+
+  fd = open(fn, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+
+  if (fd < 0)
+    PFATAL("Unable to create '%s'", fn);
+
+  ck_free(fn);
+
+  f = fdopen(fd, "w");
+
+  if (!f)
+    PFATAL("fdopen() failed");
+
+  fprintf(f, "# bucket, seeds, det_ms, havoc_ms\n");
+
+  for (u32 b = 0; b < 3; ++b)
+    fprintf(f, "%s, %u, %llu, %llu\n", bucket_names[b], bucket_seeds[b],
+            bucket_det_ms[b], bucket_havoc_ms[b]);
+
+  fprintf(f, "# bucket, stage, finds, execs\n");
+
+  for (u32 b = 0; b < 3; ++b)
+    for (u32 i = 0; i <= STAGE_CMPLOG; ++i)
+      fprintf(f, "%s, %s, %llu, %llu\n", bucket_names[b], stage_names[i],
+              bucket_finds[b][i], bucket_cycles[b][i]);
+
+  fclose(f);
+}
+
+#endif // AFLGO_IMPL
+
 static void write_stats_file(double bitmap_cvg, double stability, double eps)
 {
 
@@ -3956,6 +5518,53 @@ static void write_stats_file(double bitmap_cvg, double stability, double eps)
           orig_cmdline, slowest_exec_ms);
   /* ignore errors */
 
+#if AFLGO_IMPL
+  if (dist_prune)
+    fprintf(f, "paths_retired     : %u\n", queued_retired);
+  if (sync_id)
+    fprintf(f, "sync_skipped      : %u\n", sync_skipped);
+  if (dist_det)
+    write_bucket_stats();
+  if (dist_novelty)
+    fprintf(f, "paths_dist_novel  : %u\n", queued_dist_novel);
+  if (cmplog_mode)
+    fprintf(f, "cmplog_seeds      : %u\n"
+               "cmplog_finds      : %llu\n",
+            cmplog_seeds, stage_finds[STAGE_CMPLOG]);
+  if (reach_cov)
+    fprintf(f, "reach_edges       : %u/%u\n"
+               "paths_reach_cov   : %u\n"
+               "favored_reach     : %u\n",
+            reach_edges_seen, reach_edges, queued_reach_cov, favored_reach);
+  if (dist_trim)
+    fprintf(f, "dtrim_bytes_saved : %llu\n"
+               "dtrim_execs       : %llu\n",
+            dist_trim_saved, dist_trim_execs);
+
+  /* Seconds from start to the first reach, and id of the seed */
+
+  fprintf(f, "targets_reached   : %u/%u\n", targets_reached, target_info.target_count);
+  for (u32 i = 0; i < target_info.target_count; ++i)
+    if (target_reached[i])
+      fprintf(f, "target_%02u_reached : %llu,%06u\n", i,
+              target_reach_ms[i] / 1000, target_reach_seed[i]);
+
+  /* Replays through the sanitized binary, and per target the reach events
+     replayed, those that crashed it, and the milliseconds they took */
+
+  if (san_path)
+  {
+    fprintf(f, "san_execs         : %llu\n"
+               "san_crashes       : %llu\n"
+               "san_time          : %llu\n",
+            san_execs, san_crashes, san_time_ms / 1000);
+    for (u32 i = 0; i < target_info.target_count; ++i)
+      if (target_san_execs[i])
+        fprintf(f, "target_%02u_verified : %llu,%llu,%llu\n", i, target_san_execs[i],
+                target_san_crashes[i], target_san_ms[i]);
+  }
+#endif // AFLGO_IMPL
+
   /* Get rss value from the children
      We must have killed the forkserver process and called waitpid
      before calling getrusage */
@@ -4133,6 +5742,13 @@ static void nuke_resume_dir(void)
     goto dir_cleanup_failed;
   ck_free(fn);
 
+#if AFLGO_IMPL
+  fn = alloc_printf("%s/_resume/.state/index", out_dir);
+  if (unlink(fn) && errno != ENOENT)
+    goto dir_cleanup_failed;
+  ck_free(fn);
+#endif // AFLGO_IMPL
+
   fn = alloc_printf("%s/_resume/.state", out_dir);
   if (rmdir(fn) && errno != ENOENT)
     goto dir_cleanup_failed;
@@ -4280,6 +5896,13 @@ static void maybe_delete_out_dir(void)
     goto dir_cleanup_failed;
   ck_free(fn);
 
+#if AFLGO_IMPL
+  fn = alloc_printf("%s/queue/.state/index", out_dir);
+  if (unlink(fn) && errno != ENOENT)
+    goto dir_cleanup_failed;
+  ck_free(fn);
+#endif // AFLGO_IMPL
+
   /* Then, get rid of the .state subdirectory itself (should be empty by now)
      and everything matching <out_dir>/queue/id:*. */
 
@@ -4393,6 +6016,23 @@ static void maybe_delete_out_dir(void)
     goto dir_cleanup_failed;
   ck_free(fn);
 
+#if AFLGO_IMPL
+  fn = alloc_printf("%s/distance_extremes", out_dir);
+  if (unlink(fn) && errno != ENOENT)
+    goto dir_cleanup_failed;
+  ck_free(fn);
+
+  fn = alloc_printf("%s/dist_buckets", out_dir);
+  if (unlink(fn) && errno != ENOENT)
+    goto dir_cleanup_failed;
+  ck_free(fn);
+
+  fn = alloc_printf("%s/targets", out_dir);
+  if (delete_files(fn, "target_"))
+    goto dir_cleanup_failed;
+  ck_free(fn);
+#endif // AFLGO_IMPL
+
   OKF("Output dir cleanup successful.");
 
   /* Wow... is that all? If yes, celebrate! */
@@ -4515,6 +6155,16 @@ static void show_stats(void)
   if (total_crashes && getenv("AFL_BENCH_UNTIL_CRASH"))
     stop_soon = 2;
 
+#if AFLGO_IMPL
+
+  /* FGo: honor FGO_EXIT_WHEN_REACHED. */
+
+  if (target_info.target_count && targets_reached == target_info.target_count &&
+      getenv(EXIT_WHEN_REACHED_ENVAR))
+    stop_soon = 2;
+
+#endif // AFLGO_IMPL
+
   /* If we're not on TTY, bail out. */
 
   if (not_on_tty)
@@ -4801,6 +6451,18 @@ static void show_stats(void)
             DI(stage_finds[STAGE_EXTRAS_UI]), DI(stage_cycles[STAGE_EXTRAS_UI]),
             DI(stage_finds[STAGE_EXTRAS_AO]), DI(stage_cycles[STAGE_EXTRAS_AO]));
 
+#if AFLGO_IMPL
+
+  /* FGo: without syncing, the row shows the retired seeds instead */
+
+  if (!sync_id && dist_prune)
+    SAYF(bV bSTOP "  dictionary : " cRST "%-37s " bSTG bV bSTOP
+                  "   retired : " cRST "%-10s " bSTG bV "\n",
+         tmp, DI(queued_retired));
+  else
+
+#endif // AFLGO_IMPL
+
   SAYF(bV bSTOP "  dictionary : " cRST "%-37s " bSTG bV bSTOP
                 "  imported : " cRST "%-10s " bSTG bV "\n",
        tmp,
@@ -5040,6 +6702,153 @@ static u32 next_p2(u32 val)
    trimmer uses power-of-two increments somewhere between 1/16 and 1/1024 of
    file size, to keep the stage short and sweet. */
 
+#if AFLGO_IMPL
+
+/* FGo: directed trimming. A removal is kept when no target gets a larger
+   transitional or DF distance, whatever happens to the coverage. DF
+   distances are only compared for targets with DF hits in both the seed
+   and the trimmed run; otherwise one of them is the max placeholder. Chunks
+   are tried from the whole input down, halving only the ones that could
+   not be removed, from the end of the input to its start, so that large
+   removable parts cost a single exec. The trace, the checksum and the
+   distances of the seed are then taken from a final run. */
+
+static u8 trim_case_directed(char **argv, struct queue_entry *q, u8 *in_buf)
+{
+
+  static u8 tmp[64];
+
+  float *df = seed_df_distance(q);
+  u32 *tr = seed_tr_distance(q);
+  u8 *df_hit = seed_df_hit(q);
+  u32 cnt = target_info.target_count;
+  u32 orig_len = q->len, min_len, trim_exec = 0, i;
+  u32 stack_pos[64], stack_len[64], depth = 0;
+  u8 fault = 0, removed;
+
+  stage_name = tmp;
+  bytes_trim_in += q->len;
+
+  min_len = MAX(next_p2(q->len) / TRIM_END_STEPS, TRIM_MIN_BYTES);
+
+  stage_cur = 0;
+  stage_max = 2 * q->len / min_len;
+
+  /* Start with the two halves of the input. The whole input is never
+     removed: a chunk covering all that is left of it is only split, so
+     that at least one byte stays. */
+
+  stack_pos[depth] = 0;
+  stack_len[depth++] = q->len / 2;
+  stack_pos[depth] = q->len / 2;
+  stack_len[depth++] = q->len - q->len / 2;
+
+  while (depth)
+  {
+
+    u32 pos = stack_pos[--depth], len = stack_len[depth];
+
+    removed = 0;
+
+    if (len < q->len)
+    {
+
+      sprintf(tmp, "dtrim %s/%s", DI(len), DI(q->len));
+
+      write_with_gap(in_buf, q->len, pos, len);
+
+      fault = run_target(argv, exec_tmout);
+      trim_execs++;
+      dist_trim_execs++;
+
+      if (stop_soon || fault == FAULT_ERROR)
+        goto abort_trimming;
+
+      decode_target_distances(trace_bits + MAP_SIZE);
+
+      for (i = 0; i < cnt; ++i)
+        if (cur_tr_distance[i] > tr[i] ||
+            (df_hit[i] && cur_df_hit[i] && (float)cur_df_distance[i] > df[i]))
+          break;
+
+      if (!fault && i == cnt)
+      {
+
+        memmove(in_buf + pos, in_buf + pos + len, q->len - pos - len);
+        q->len -= len;
+        removed = 1;
+      }
+    }
+
+    if (!removed && len >= 2 * min_len && depth + 2 <= 64)
+    {
+
+      /* Left half first on the stack, so that the right one goes first */
+
+      stack_pos[depth] = pos;
+      stack_len[depth++] = len / 2;
+      stack_pos[depth] = pos + len / 2;
+      stack_len[depth++] = len - len / 2;
+    }
+
+    if (!(trim_exec++ % stats_update_freq))
+      show_stats();
+    stage_cur++;
+  }
+
+  if (q->len != orig_len)
+  {
+
+    s32 fd;
+
+    unlink(q->fname); /* ignore errors */
+
+    fd = open(q->fname, O_WRONLY | O_CREAT | O_EXCL, 0600);
+
+    if (fd < 0)
+      PFATAL("Unable to create '%s'", q->fname);
+
+    ck_write(fd, in_buf, q->len, q->fname);
+    close(fd);
+
+    index_queue_entry(q, in_buf);
+
+    dist_trim_saved += orig_len - q->len;
+
+    /* The coverage may have changed, so the trace is taken again. */
+
+    write_to_testcase(in_buf, q->len);
+
+    fault = run_target(argv, exec_tmout);
+    trim_execs++;
+    dist_trim_execs++;
+
+    if (stop_soon || fault == FAULT_ERROR)
+      goto abort_trimming;
+
+    q->exec_cksum = hash32(trace_bits, MAP_SIZE, HASH_CONST);
+    q->bitmap_size = count_bytes(trace_bits);
+
+    if (q->trace_mini)
+    {
+      memset(q->trace_mini, 0, MAP_SIZE >> 3);
+      minimize_bits(q->trace_mini, trace_bits);
+    }
+
+    decode_target_distances(trace_bits + MAP_SIZE);
+    set_seed_distances(q);
+
+    update_bitmap_score(q);
+  }
+
+abort_trimming:
+
+  bytes_trim_out += q->len;
+  return fault;
+}
+
+#endif // AFLGO_IMPL
+
 static u8 trim_case(char **argv, struct queue_entry *q, u8 *in_buf)
 {
 
@@ -5058,6 +6867,11 @@ static u8 trim_case(char **argv, struct queue_entry *q, u8 *in_buf)
   if (q->len < 5)
     return 0;
 
+#if AFLGO_IMPL
+  if (dist_trim && seed_df_distance(q)[0] > 0)
+    return trim_case_directed(argv, q, in_buf);
+#endif // AFLGO_IMPL
+
   stage_name = tmp;
   bytes_trim_in += q->len;
 
@@ -5155,6 +6969,10 @@ static u8 trim_case(char **argv, struct queue_entry *q, u8 *in_buf)
     ck_write(fd, in_buf, q->len, q->fname);
     close(fd);
 
+#if AFLGO_IMPL
+    index_queue_entry(q, in_buf);
+#endif // AFLGO_IMPL
+
     memcpy(trace_bits, clean_trace, MAP_SIZE);
     update_bitmap_score(q);
   }
@@ -5315,398 +7133,734 @@ static u32 calculate_score(struct queue_entry *q)
   else if (q->bitmap_size * 1.5 < avg_bitmap_size)
     perf_score *= 0.75;
 
-  /* Adjust score based on handicap. Handicap is proportional to how late
-     in the game we learned about this path. Latecomers are allowed to run
-     for a bit longer until they catch up with the rest. */
+  /* Adjust score based on handicap. Handicap is proportional to how late
+     in the game we learned about this path. Latecomers are allowed to run
+     for a bit longer until they catch up with the rest. */
+
+  if (q->handicap >= 4)
+  {
+
+    perf_score *= 4;
+    q->handicap -= 4;
+  }
+  else if (q->handicap)
+  {
+
+    perf_score *= 2;
+    q->handicap--;
+  }
+
+  /* Final adjustment based on input depth, under the assumption that fuzzing
+     deeper test cases is more likely to reveal stuff that can't be
+     discovered with traditional fuzzers. */
+
+  switch (q->depth)
+  {
+
+  case 0 ... 3:
+    break;
+  case 4 ... 7:
+    perf_score *= 2;
+    break;
+  case 8 ... 13:
+    perf_score *= 3;
+    break;
+  case 14 ... 25:
+    perf_score *= 4;
+    break;
+  default:
+    perf_score *= 5;
+  }
+
+#if AFLGO_IMPL
+
+  double T = get_cooling_temperature(get_cur_time());
+
+  double power_factor = 1.0;
+
+  // if (q->distance > 0)
+  // {
+
+  //   double normalized_d = 0; // when "max_distance == min_distance", we set the normalized_d to 0 so that we can sufficiently explore those testcases whose distance >= 0.
+  //   if (max_distance != min_distance)
+  //     normalized_d = (q->distance - min_distance) / (max_distance - min_distance);
+
+  //   if (normalized_d >= 0)
+  //   {
+
+  //     double p = (1.0 - normalized_d) * (1.0 - T) + 0.5 * T;
+  //     power_factor = pow(2.0, 2.0 * (double)log2(MAX_FACTOR) * (p - 0.5));
+
+  //   } // else WARNF ("Normalized distance negative: %f", normalized_d);
+  // }
+
+  if (seed_df_distance(q)[0] > 0)
+  {
+    /* power factor */
+
+    double p = (1.0 - get_seed_dist_prob(q)) * (1.0 - T) + 0.5 * T;
+    power_factor = pow(2.0, 2.0 * (double)log2(MAX_FACTOR) * (p - 0.5));
+  }
+
+  perf_score *= power_factor;
+
+#endif // AFLGO_IMPL
+
+  /* Make sure that we don't go over limit. */
+
+  if (perf_score > HAVOC_MAX_MULT * 100)
+    perf_score = HAVOC_MAX_MULT * 100;
+
+#if AFLGO_IMPL
+    /* AFLGO-DEBUGGING */
+    /*
+    fprintf(stderr, "[Time %llu] "
+                    "q->distance: %4lf, "
+                    "max_distance: %4lf, "
+                    "min_distance: %4lf, "
+                    "T: %4.3lf, "
+                    "power_factor: %4.3lf, "
+                    "adjusted perf_score: %4d\n",
+      t, q->distance, max_distance, min_distance, T, power_factor, perf_score);
+    */
+    // /* FGo: debug */
+    // fprintf(fgo_file_handler, "[Time %llu] "
+    //                           "q->distance: %4lf, "
+    //                           "max_distance: %4lf, "
+    //                           "min_distance: %4lf, "
+    //                           "T: %4.3lf, "
+    //                           "power_factor: %4.3lf, "
+    //                           "adjusted perf_score: %4d\n",
+    //         t, q->distance, max_distance, min_distance, T, power_factor, perf_score);
+#endif // AFLGO_IMPL
+
+  return perf_score;
+}
+
+/* Helper function to see if a particular change (xor_val = old ^ new) could
+   be a product of deterministic bit flips with the lengths and stepovers
+   attempted by afl-fuzz. This is used to avoid dupes in some of the
+   deterministic fuzzing operations that follow bit flips. We also
+   return 1 if xor_val is zero, which implies that the old and attempted new
+   values are identical and the exec would be a waste of time. */
+
+static u8 could_be_bitflip(u32 xor_val)
+{
+
+  u32 sh = 0;
+
+  if (!xor_val)
+    return 1;
+
+  /* Shift left until first bit set. */
+
+  while (!(xor_val & 1))
+  {
+    sh++;
+    xor_val >>= 1;
+  }
+
+  /* 1-, 2-, and 4-bit patterns are OK anywhere. */
+
+  if (xor_val == 1 || xor_val == 3 || xor_val == 15)
+    return 1;
+
+  /* 8-, 16-, and 32-bit patterns are OK only if shift factor is
+     divisible by 8, since that's the stepover for these ops. */
+
+  if (sh & 7)
+    return 0;
+
+  if (xor_val == 0xff || xor_val == 0xffff || xor_val == 0xffffffff)
+    return 1;
+
+  return 0;
+}
+
+/* Helper function to see if a particular value is reachable through
+   arithmetic operations. Used for similar purposes. */
+
+static u8 could_be_arith(u32 old_val, u32 new_val, u8 blen)
+{
+
+  u32 i, ov = 0, nv = 0, diffs = 0;
+
+  if (old_val == new_val)
+    return 1;
 
-  if (q->handicap >= 4)
-  {
+  /* See if one-byte adjustments to any byte could produce this result. */
 
-    perf_score *= 4;
-    q->handicap -= 4;
-  }
-  else if (q->handicap)
+  for (i = 0; i < blen; i++)
   {
 
-    perf_score *= 2;
-    q->handicap--;
+    u8 a = old_val >> (8 * i),
+       b = new_val >> (8 * i);
+
+    if (a != b)
+    {
+      diffs++;
+      ov = a;
+      nv = b;
+    }
   }
 
-  /* Final adjustment based on input depth, under the assumption that fuzzing
-     deeper test cases is more likely to reveal stuff that can't be
-     discovered with traditional fuzzers. */
+  /* If only one byte differs and the values are within range, return 1. */
 
-  switch (q->depth)
+  if (diffs == 1)
   {
 
-  case 0 ... 3:
-    break;
-  case 4 ... 7:
-    perf_score *= 2;
-    break;
-  case 8 ... 13:
-    perf_score *= 3;
-    break;
-  case 14 ... 25:
-    perf_score *= 4;
-    break;
-  default:
-    perf_score *= 5;
+    if ((u8)(ov - nv) <= ARITH_MAX ||
+        (u8)(nv - ov) <= ARITH_MAX)
+      return 1;
   }
 
-#if AFLGO_IMPL
+  if (blen == 1)
+    return 0;
 
-  u64 cur_ms = get_cur_time();
-  u64 t = (cur_ms - start_time) / 1000;
-  double progress_to_tx = ((double)t) / ((double)t_x * 60.0);
+  /* See if two-byte adjustments to any byte would produce this result. */
 
-  double T;
+  diffs = 0;
 
-  // TODO Substitute functions of exp and log with faster bitwise operations on integers
-  switch (cooling_schedule)
+  for (i = 0; i < blen / 2; i++)
   {
-  case SAN_EXP:
 
-    T = 1.0 / pow(20.0, progress_to_tx);
+    u16 a = old_val >> (16 * i),
+        b = new_val >> (16 * i);
 
-    break;
+    if (a != b)
+    {
+      diffs++;
+      ov = a;
+      nv = b;
+    }
+  }
 
-  case SAN_LOG:
+  /* If only one word differs and the values are within range, return 1. */
 
-    // alpha = 2 and exp(19/2) - 1 = 13358.7268297
-    T = 1.0 / (1.0 + 2.0 * log(1.0 + progress_to_tx * 13358.7268297));
+  if (diffs == 1)
+  {
 
-    break;
+    if ((u16)(ov - nv) <= ARITH_MAX ||
+        (u16)(nv - ov) <= ARITH_MAX)
+      return 1;
 
-  case SAN_LIN:
+    ov = SWAP16(ov);
+    nv = SWAP16(nv);
 
-    T = 1.0 / (1.0 + 19.0 * progress_to_tx);
+    if ((u16)(ov - nv) <= ARITH_MAX ||
+        (u16)(nv - ov) <= ARITH_MAX)
+      return 1;
+  }
 
-    break;
+  /* Finally, let's do the same thing for dwords. */
 
-  case SAN_QUAD:
+  if (blen == 4)
+  {
 
-    T = 1.0 / (1.0 + 19.0 * pow(progress_to_tx, 2));
+    if ((u32)(old_val - new_val) <= ARITH_MAX ||
+        (u32)(new_val - old_val) <= ARITH_MAX)
+      return 1;
 
-    break;
+    new_val = SWAP32(new_val);
+    old_val = SWAP32(old_val);
 
-  default:
-    PFATAL("Unkown Power Schedule for Directed Fuzzing");
+    if ((u32)(old_val - new_val) <= ARITH_MAX ||
+        (u32)(new_val - old_val) <= ARITH_MAX)
+      return 1;
   }
 
-  double power_factor = 1.0;
+  return 0;
+}
 
-  // if (q->distance > 0)
-  // {
+/* Last but not least, a similar helper to see if insertion of an
+   interesting integer is redundant given the insertions done for
+   shorter blen. The last param (check_le) is set if the caller
+   already executed LE insertion for current blen and wants to see
+   if BE variant passed in new_val is unique. */
 
-  //   double normalized_d = 0; // when "max_distance == min_distance", we set the normalized_d to 0 so that we can sufficiently explore those testcases whose distance >= 0.
-  //   if (max_distance != min_distance)
-  //     normalized_d = (q->distance - min_distance) / (max_distance - min_distance);
+static u8 could_be_interest(u32 old_val, u32 new_val, u8 blen, u8 check_le)
+{
 
-  //   if (normalized_d >= 0)
-  //   {
+  u32 i, j;
 
-  //     double p = (1.0 - normalized_d) * (1.0 - T) + 0.5 * T;
-  //     power_factor = pow(2.0, 2.0 * (double)log2(MAX_FACTOR) * (p - 0.5));
+  if (old_val == new_val)
+    return 1;
 
-  //   } // else WARNF ("Normalized distance negative: %f", normalized_d);
-  // }
+  /* See if one-byte insertions from interesting_8 over old_val could
+     produce new_val. */
 
-  if (q->df_distance[0] > 0)
+  for (i = 0; i < blen; i++)
   {
-    /* Average distance */
 
-    double prob_avg = 0.0;
-    for (u32 i = 0; i < target_info.target_count; ++i)
+    for (j = 0; j < sizeof(interesting_8); j++)
     {
-      double tmp_prob_df = (q->df_distance[i] - min_df_distance[i]) / (max_df_distance[i] - min_df_distance[i]);
-      double tmp_prob_bt = (q->bt_distance[i] - min_bt_distance[i]) / (max_bt_distance[i] - min_bt_distance[i]);
-      double tmp_prob_avg = 0.7 * tmp_prob_df + 0.3 * tmp_prob_bt;
-      if (tmp_prob_avg <= 0.0)
-      {
-        prob_avg = 0.0;
-        break;
-      }
-      else if (tmp_prob_avg > 1.0)
-        tmp_prob_avg = 1.0;
-      prob_avg += (1.0 / tmp_prob_avg);
+
+      u32 tval = (old_val & ~(0xff << (i * 8))) |
+                 (((u8)interesting_8[j]) << (i * 8));
+
+      if (new_val == tval)
+        return 1;
     }
-    if (prob_avg > 0.0)
-      prob_avg = (double)(target_info.target_count) / prob_avg;
+  }
 
-    /* Transitional distance */
+  /* Bail out unless we're also asked to examine two-byte LE insertions
+     as a preparation for BE attempts. */
 
-    double prob_trans = 0.0;
-    for (u32 i = 0; i < target_info.target_count; ++i)
+  if (blen == 2 && !check_le)
+    return 0;
+
+  /* See if two-byte insertions over old_val could give us new_val. */
+
+  for (i = 0; i < blen - 1; i++)
+  {
+
+    for (j = 0; j < sizeof(interesting_16) / 2; j++)
     {
-      double tmp_prob_trans = helper_get_quantile(&target_info, i, q->tr_distance[i]);
-      if (tmp_prob_trans <= 0.0)
+
+      u32 tval = (old_val & ~(0xffff << (i * 8))) |
+                 (((u16)interesting_16[j]) << (i * 8));
+
+      if (new_val == tval)
+        return 1;
+
+      /* Continue here only if blen > 2. */
+
+      if (blen > 2)
       {
-        prob_trans = 0.0;
-        break;
+
+        tval = (old_val & ~(0xffff << (i * 8))) |
+               (SWAP16(interesting_16[j]) << (i * 8));
+
+        if (new_val == tval)
+          return 1;
       }
-      else if (tmp_prob_trans > 1.0)
-        tmp_prob_trans = 1.0;
-      prob_trans += (1.0 / tmp_prob_trans);
     }
-    if (prob_trans > 0.0)
-      prob_trans = (double)(target_info.target_count) / prob_trans;
+  }
 
-    /* power factor */
+  if (blen == 4 && check_le)
+  {
 
-    double p = (1.0 - ((prob_avg + prob_trans) / 2.0)) * (1.0 - T) + 0.5 * T;
-    power_factor = pow(2.0, 2.0 * (double)log2(MAX_FACTOR) * (p - 0.5));
+    /* See if four-byte insertions could produce the same result
+       (LE only). */
+
+    for (j = 0; j < sizeof(interesting_32) / 4; j++)
+      if (new_val == (u32)interesting_32[j])
+        return 1;
   }
 
-  perf_score *= power_factor;
+  return 0;
+}
 
-#endif // AFLGO_IMPL
+#if AFLGO_IMPL
 
-  /* Make sure that we don't go over limit. */
+/* FGo: distance-sensitive offsets of the seed being fuzzed, ascending. */
 
-  if (perf_score > HAVOC_MAX_MULT * 100)
-    perf_score = HAVOC_MAX_MULT * 100;
+static u32 *dist_pos, dist_pos_cnt;
 
-#if AFLGO_IMPL
-    /* AFLGO-DEBUGGING */
-    /*
-    fprintf(stderr, "[Time %llu] "
-                    "q->distance: %4lf, "
-                    "max_distance: %4lf, "
-                    "min_distance: %4lf, "
-                    "T: %4.3lf, "
-                    "power_factor: %4.3lf, "
-                    "adjusted perf_score: %4d\n",
-      t, q->distance, max_distance, min_distance, T, power_factor, perf_score);
-    */
-    // /* FGo: debug */
-    // fprintf(fgo_file_handler, "[Time %llu] "
-    //                           "q->distance: %4lf, "
-    //                           "max_distance: %4lf, "
-    //                           "min_distance: %4lf, "
-    //                           "T: %4.3lf, "
-    //                           "power_factor: %4.3lf, "
-    //                           "adjusted perf_score: %4d\n",
-    //         t, q->distance, max_distance, min_distance, T, power_factor, perf_score);
-#endif // AFLGO_IMPL
+/* FGo: pick an offset in [lo, hi). DIST_GRAD_BIAS% of the time, it is one
+   of the distance-sensitive offsets in the range, if there is any. */
 
-  return perf_score;
+static u32 pick_dist_pos(u32 lo, u32 hi)
+{
+
+  if (dist_pos_cnt && UR(100) < DIST_GRAD_BIAS)
+  {
+    u32 a = 0, b = dist_pos_cnt, m, first;
+
+    while (a < b)
+    {
+      m = (a + b) / 2;
+      if (dist_pos[m] < lo)
+        a = m + 1;
+      else
+        b = m;
+    }
+    first = a;
+
+    b = dist_pos_cnt;
+    while (a < b)
+    {
+      m = (a + b) / 2;
+      if (dist_pos[m] < hi)
+        a = m + 1;
+      else
+        b = m;
+    }
+
+    if (a > first)
+      return dist_pos[first + UR(a - first)];
+  }
+
+  return lo + UR(hi - lo);
 }
 
-/* Helper function to see if a particular change (xor_val = old ^ new) could
-   be a product of deterministic bit flips with the lengths and stepovers
-   attempted by afl-fuzz. This is used to avoid dupes in some of the
-   deterministic fuzzing operations that follow bit flips. We also
-   return 1 if xor_val is zero, which implies that the old and attempted new
-   values are identical and the exec would be a waste of time. */
+#define UR_POS(_limit) pick_dist_pos(0, (_limit))
 
-static u8 could_be_bitflip(u32 xor_val)
+/* FGo: find the bytes of a seed close to the targets that move its
+   distances, by inverting each of them in turn and comparing the decoded
+   distances with the ones of the unmodified seed. This is done once per
+   seed; the offsets are kept in the queue entry. Returns 1 if fuzzing is
+   to be abandoned. */
+
+static u8 infer_dist_bytes(char **argv, u8 *out_buf, u32 len)
 {
 
-  u32 sh = 0;
+  struct queue_entry *q = queue_cur;
+  u32 base_tr[FGO_TARGET_MAX_COUNT];
+  double base_df[FGO_TARGET_MAX_COUNT];
+  u32 cnt = target_info.target_count;
+  u64 orig_hit_cnt;
+
+  if (q->dist_inferred || q->var_behavior || len > DIST_GRAD_MAX_LEN ||
+      seed_df_distance(q)[0] <= 0 || get_seed_dist_prob(q) > DIST_GRAD_MAX_PROB)
+    return 0;
+
+  q->dist_inferred = 1;
+
+  stage_short = "dinfer";
+  stage_name = "dist infer";
+  stage_max = len;
+  stage_val_type = STAGE_VAL_NONE;
+
+  orig_hit_cnt = queued_paths + unique_crashes;
+
+  if (common_fuzz_stuff(argv, out_buf, len))
+    return 1;
+
+  decode_target_distances(trace_bits + MAP_SIZE);
+  memcpy(base_tr, cur_tr_distance, cnt * sizeof(u32));
+  memcpy(base_df, cur_df_distance, cnt * sizeof(double));
+
+  q->dist_pos = ck_alloc(len * sizeof(u32));
+
+  for (stage_cur = 0; stage_cur < stage_max; stage_cur++)
+  {
+    stage_cur_byte = stage_cur;
+    out_buf[stage_cur] ^= 0xFF;
+
+    if (common_fuzz_stuff(argv, out_buf, len))
+      return 1;
+
+    out_buf[stage_cur] ^= 0xFF;
 
-  if (!xor_val)
-    return 1;
+    decode_target_distances(trace_bits + MAP_SIZE);
 
-  /* Shift left until first bit set. */
+    for (u32 i = 0; i < cnt; ++i)
+      if (cur_tr_distance[i] != base_tr[i] || cur_df_distance[i] != base_df[i])
+      {
+        q->dist_pos[q->dist_pos_cnt++] = stage_cur;
+        break;
+      }
+  }
 
-  while (!(xor_val & 1))
+  if (!q->dist_pos_cnt)
   {
-    sh++;
-    xor_val >>= 1;
+    ck_free(q->dist_pos);
+    q->dist_pos = NULL;
   }
 
-  /* 1-, 2-, and 4-bit patterns are OK anywhere. */
+  stage_finds[STAGE_DIST_INFER] += queued_paths + unique_crashes - orig_hit_cnt;
+  stage_cycles[STAGE_DIST_INFER] += stage_max + 1;
 
-  if (xor_val == 1 || xor_val == 3 || xor_val == 15)
-    return 1;
+  return 0;
+}
 
-  /* 8-, 16-, and 32-bit patterns are OK only if shift factor is
-     divisible by 8, since that's the stepover for these ops. */
+/* FGo: run an input with the comparison logging on, and copy the table
+   into log. */
 
-  if (sh & 7)
-    return 0;
+static u8 run_cmplog(char **argv, u8 *buf, u32 len, struct cmp_map *log)
+{
 
-  if (xor_val == 0xff || xor_val == 0xffff || xor_val == 0xffffffff)
-    return 1;
+  u8 fault;
 
-  return 0;
+  write_to_testcase(buf, len);
+
+  memset(cmp_map->headers, 0, sizeof(cmp_map->headers));
+  cmp_map->active = 1;
+
+  fault = run_target(argv, exec_tmout);
+
+  cmp_map->active = 0;
+  memcpy(log, cmp_map, sizeof(struct cmp_map));
+
+  return fault;
 }
 
-/* Helper function to see if a particular value is reachable through
-   arithmetic operations. Used for similar purposes. */
+/* FGo: replace as many bytes of the current input as possible with random
+   ones, keeping its execution path, so that the operands which change with
+   them tell the input-to-state comparisons apart. A range changing the path
+   is restored and split in halves, within CMPLOG_COLOR_EXECS runs. Returns
+   1 if the seed should be abandoned. */
 
-static u8 could_be_arith(u32 old_val, u32 new_val, u8 blen)
+static u8 colorize_case(char **argv, u8 *buf, u8 *color, u32 len)
 {
 
-  u32 i, ov = 0, nv = 0, diffs = 0;
+  u32 *ranges = ck_alloc(2 * (len + 1) * sizeof(u32));
+  u8 *rnd = ck_alloc_nozero(len);
+  u32 i, top = 0, execs = 0;
+  u8 fault;
 
-  if (old_val == new_val)
-    return 1;
+  for (i = 0; i < len; i++)
+    rnd[i] = buf[i] ^ (1 + UR(255));
 
-  /* See if one-byte adjustments to any byte could produce this result. */
+  memcpy(color, buf, len);
 
-  for (i = 0; i < blen; i++)
+  ranges[top++] = 0;
+  ranges[top++] = len;
+
+  stage_name = "colorize";
+
+  while (top && execs++ < CMPLOG_COLOR_EXECS)
   {
 
-    u8 a = old_val >> (8 * i),
-       b = new_val >> (8 * i);
+    u32 end = ranges[--top], start = ranges[--top];
 
-    if (a != b)
+    memcpy(color + start, rnd + start, end - start);
+    write_to_testcase(color, len);
+
+    fault = run_target(argv, exec_tmout);
+
+    if (stop_soon)
     {
-      diffs++;
-      ov = a;
-      nv = b;
+      ck_free(ranges);
+      ck_free(rnd);
+      return 1;
     }
-  }
 
-  /* If only one byte differs and the values are within range, return 1. */
+    if (fault || hash32(trace_bits, MAP_SIZE, HASH_CONST) != queue_cur->exec_cksum)
+    {
 
-  if (diffs == 1)
-  {
+      memcpy(color + start, buf + start, end - start);
 
-    if ((u8)(ov - nv) <= ARITH_MAX ||
-        (u8)(nv - ov) <= ARITH_MAX)
-      return 1;
+      if (end - start > 1)
+      {
+        u32 mid = start + (end - start) / 2;
+
+        ranges[top++] = start;
+        ranges[top++] = mid;
+        ranges[top++] = mid;
+        ranges[top++] = end;
+      }
+    }
   }
 
-  if (blen == 1)
-    return 0;
+  stage_cycles[STAGE_CMPLOG] += execs;
 
-  /* See if two-byte adjustments to any byte would produce this result. */
+  ck_free(ranges);
+  ck_free(rnd);
 
-  diffs = 0;
+  return 0;
+}
 
-  for (i = 0; i < blen / 2; i++)
+/* FGo: write the size lowest bytes of v to dst, in either byte order. */
+
+static void cmplog_encode(u8 *dst, u64 v, u8 size, u8 big_endian)
+{
+
+  u8 i;
+
+  for (i = 0; i < size; i++)
+    dst[big_endian ? size - 1 - i : i] = v >> (i << 3);
+}
+
+/* FGo: put repl in place of an integer operand wherever the input holds it,
+   in either byte order, and the colorized input holds its colorized value,
+   i.e. where the operand was read from. Returns 1 if the seed should be
+   abandoned. */
+
+static u8 its_try_ins(char **argv, u8 *buf, u8 *color, u32 len,
+                      u64 pattern, u64 color_pattern, u64 repl, u8 size)
+{
+
+  u8 pat[8], col[8], rep[8], be;
+  u32 pos;
+
+  if (pattern == color_pattern || pattern == repl || !size || size > 8 || size > len)
+    return 0;
+
+  for (be = 0; be < (size > 1 ? 2 : 1); be++)
   {
 
-    u16 a = old_val >> (16 * i),
-        b = new_val >> (16 * i);
+    cmplog_encode(pat, pattern, size, be);
+    cmplog_encode(col, color_pattern, size, be);
+    cmplog_encode(rep, repl, size, be);
 
-    if (a != b)
+    for (pos = 0; pos + size <= len; pos++)
     {
-      diffs++;
-      ov = a;
-      nv = b;
-    }
-  }
 
-  /* If only one word differs and the values are within range, return 1. */
+      if (memcmp(buf + pos, pat, size) || memcmp(color + pos, col, size))
+        continue;
 
-  if (diffs == 1)
-  {
+      if (stage_cur >= stage_max)
+        return 0;
 
-    if ((u16)(ov - nv) <= ARITH_MAX ||
-        (u16)(nv - ov) <= ARITH_MAX)
-      return 1;
+      stage_cur_byte = pos;
+      memcpy(buf + pos, rep, size);
 
-    ov = SWAP16(ov);
-    nv = SWAP16(nv);
+      if (common_fuzz_stuff(argv, buf, len))
+      {
+        memcpy(buf + pos, pat, size);
+        return 1;
+      }
 
-    if ((u16)(ov - nv) <= ARITH_MAX ||
-        (u16)(nv - ov) <= ARITH_MAX)
-      return 1;
+      memcpy(buf + pos, pat, size);
+      stage_cur++;
+    }
   }
 
-  /* Finally, let's do the same thing for dwords. */
+  return 0;
+}
 
-  if (blen == 4)
+/* FGo: the same for routine operands, which need to match for
+   CMPLOG_RTN_MIN_MATCH bytes at least (or all of them, if shorter). */
+
+static u8 its_try_rtn(char **argv, u8 *buf, u8 *color, u32 len,
+                      u8 *pattern, u8 *color_pattern, u8 *repl, u8 size)
+{
+
+  u8 save[CMP_RTN_LEN];
+  u32 pos, match, n;
+
+  if (!size || !memcmp(pattern, color_pattern, size) || !memcmp(pattern, repl, size))
+    return 0;
+
+  for (pos = 0; pos < len; pos++)
   {
 
-    if ((u32)(old_val - new_val) <= ARITH_MAX ||
-        (u32)(new_val - old_val) <= ARITH_MAX)
-      return 1;
+    for (match = 0; match < size && pos + match < len; match++)
+      if (buf[pos + match] != pattern[match] || color[pos + match] != color_pattern[match])
+        break;
 
-    new_val = SWAP32(new_val);
-    old_val = SWAP32(old_val);
+    if (match < MIN(size, CMPLOG_RTN_MIN_MATCH))
+      continue;
 
-    if ((u32)(old_val - new_val) <= ARITH_MAX ||
-        (u32)(new_val - old_val) <= ARITH_MAX)
+    if (stage_cur >= stage_max)
+      return 0;
+
+    n = MIN(size, len - pos);
+
+    stage_cur_byte = pos;
+    memcpy(save, buf + pos, n);
+    memcpy(buf + pos, repl, n);
+
+    if (common_fuzz_stuff(argv, buf, len))
+    {
+      memcpy(buf + pos, save, n);
       return 1;
+    }
+
+    memcpy(buf + pos, save, n);
+    stage_cur++;
   }
 
   return 0;
 }
 
-/* Last but not least, a similar helper to see if insertion of an
-   interesting integer is redundant given the insertions done for
-   shorter blen. The last param (check_le) is set if the caller
-   already executed LE insertion for current blen and wants to see
-   if BE variant passed in new_val is unique. */
+/* FGo: input-to-state stage, done once for the seeds close to the targets.
+   The comparisons in their code are logged for the input and a colorized
+   copy of it; every operand that changed with the colorization is then
+   replaced with the other operand where the input holds it. Returns 1 if
+   the seed should be abandoned. */
 
-static u8 could_be_interest(u32 old_val, u32 new_val, u8 blen, u8 check_le)
+static u8 cmplog_stage(char **argv, u8 *buf, u32 len)
 {
 
-  u32 i, j;
+  struct queue_entry *q = queue_cur;
+  struct cmp_map *orig_log, *color_log;
+  u64 orig_hit_cnt;
+  u8 *color, ret = 1;
+  u32 k, j;
 
-  if (old_val == new_val)
-    return 1;
+  if (!cmp_map || q->cmplog_done || q->var_behavior || len > CMPLOG_MAX_LEN ||
+      seed_df_distance(q)[0] <= 0 || get_seed_dist_prob(q) > CMPLOG_MAX_PROB)
+    return 0;
 
-  /* See if one-byte insertions from interesting_8 over old_val could
-     produce new_val. */
+  q->cmplog_done = 1;
+  cmplog_seeds++;
 
-  for (i = 0; i < blen; i++)
-  {
+  stage_short = "its";
+  stage_name = "input-to-state";
+  stage_cur = 0;
+  stage_max = CMPLOG_MAX_EXECS;
+  stage_cur_byte = -1;
+  stage_val_type = STAGE_VAL_NONE;
 
-    for (j = 0; j < sizeof(interesting_8); j++)
-    {
+  orig_hit_cnt = queued_paths + unique_crashes;
 
-      u32 tval = (old_val & ~(0xff << (i * 8))) |
-                 (((u8)interesting_8[j]) << (i * 8));
+  orig_log = ck_alloc_nozero(sizeof(struct cmp_map));
+  color_log = ck_alloc_nozero(sizeof(struct cmp_map));
+  color = ck_alloc_nozero(len);
 
-      if (new_val == tval)
-        return 1;
-    }
-  }
+  if (colorize_case(argv, buf, color, len))
+    goto abort_cmplog;
 
-  /* Bail out unless we're also asked to examine two-byte LE insertions
-     as a preparation for BE attempts. */
+  run_cmplog(argv, buf, len, orig_log);
+  run_cmplog(argv, color, len, color_log);
 
-  if (blen == 2 && !check_le)
-    return 0;
+  if (stop_soon)
+    goto abort_cmplog;
 
-  /* See if two-byte insertions over old_val could give us new_val. */
+  stage_name = "input-to-state";
 
-  for (i = 0; i < blen - 1; i++)
+  for (k = 0; k < CMP_MAP_W; k++)
   {
 
-    for (j = 0; j < sizeof(interesting_16) / 2; j++)
+    struct cmp_header *oh = &orig_log->headers[k], *ch = &color_log->headers[k];
+    u32 hits = MIN(MIN(oh->hits, ch->hits), CMP_MAP_H);
+
+    if (oh->type != ch->type || oh->size != ch->size)
+      continue;
+
+    for (j = 0; j < hits; j++)
     {
 
-      u32 tval = (old_val & ~(0xffff << (i * 8))) |
-                 (((u16)interesting_16[j]) << (i * 8));
+      if (oh->type == CMP_TYPE_INS)
+      {
 
-      if (new_val == tval)
-        return 1;
+        struct cmp_operands *o = &orig_log->log[k].ops[j], *c = &color_log->log[k].ops[j];
 
-      /* Continue here only if blen > 2. */
+        if (j && !memcmp(o, o - 1, sizeof(struct cmp_operands)))
+          continue;
 
-      if (blen > 2)
+        if (its_try_ins(argv, buf, color, len, o->v0, c->v0, o->v1, oh->size) ||
+            its_try_ins(argv, buf, color, len, o->v1, c->v1, o->v0, oh->size))
+          goto abort_cmplog;
+      }
+      else
       {
 
-        tval = (old_val & ~(0xffff << (i * 8))) |
-               (SWAP16(interesting_16[j]) << (i * 8));
+        struct cmp_rtn_operands *o = &orig_log->log[k].rtn[j], *c = &color_log->log[k].rtn[j];
 
-        if (new_val == tval)
-          return 1;
+        if (j && !memcmp(o, o - 1, sizeof(struct cmp_rtn_operands)))
+          continue;
+
+        if (its_try_rtn(argv, buf, color, len, o->v0, c->v0, o->v1, oh->size) ||
+            its_try_rtn(argv, buf, color, len, o->v1, c->v1, o->v0, oh->size))
+          goto abort_cmplog;
       }
     }
   }
 
-  if (blen == 4 && check_le)
-  {
+  ret = 0;
 
-    /* See if four-byte insertions could produce the same result
-       (LE only). */
+abort_cmplog:
 
-    for (j = 0; j < sizeof(interesting_32) / 4; j++)
-      if (new_val == (u32)interesting_32[j])
-        return 1;
-  }
+  stage_finds[STAGE_CMPLOG] += queued_paths + unique_crashes - orig_hit_cnt;
+  stage_cycles[STAGE_CMPLOG] += stage_cur + 2;
 
-  return 0;
+  ck_free(orig_log);
+  ck_free(color_log);
+  ck_free(color);
+
+  return ret;
 }
 
+#else
+
+#define UR_POS(_limit) UR(_limit)
+
+#endif // AFLGO_IMPL
+
 /* Take the current entry from the queue, fuzz it for a while. This
    function is a tad too long... returns 0 if fuzzed successfully, 1 if
    skipped or bailed out. */
@@ -5724,6 +7878,12 @@ static u8 fuzz_one(char **argv)
   u8 a_collect[MAX_AUTO_EXTRA];
   u32 a_len = 0;
 
+#if AFLGO_IMPL
+  u8 bucket = DIST_BUCKET_MID;
+  u64 bucket_start_ms = 0, bucket_havoc_start_ms = 0;
+  u64 orig_stage_finds[32], orig_stage_cycles[32];
+#endif // AFLGO_IMPL
+
 #ifdef IGNORE_FINDS
 
   /* In IGNORE_FINDS mode, skip any entries that weren't in the
@@ -5734,6 +7894,19 @@ static u8 fuzz_one(char **argv)
 
 #else
 
+#if AFLGO_IMPL
+
+    /* FGo: retired seeds are always skipped, and seeds picked by distance
+       are never skipped otherwise. */
+
+    if (queue_cur->retired)
+      return 1;
+
+    if (dist_sched_picked)
+      goto skip_checked;
+
+#endif // AFLGO_IMPL
+
     if (pending_favored)
     {
 
@@ -5768,6 +7941,10 @@ static u8 fuzz_one(char **argv)
 
 #endif /* ^IGNORE_FINDS */
 
+#if AFLGO_IMPL
+skip_checked:
+#endif // AFLGO_IMPL
+
   if (not_on_tty)
   {
     ACTF("Fuzzing test case #%u (%u total, %llu uniq crashes found)...",
@@ -5866,6 +8043,48 @@ static u8 fuzz_one(char **argv)
 
   orig_perf = perf_score = calculate_score(queue_cur);
 
+#if AFLGO_IMPL
+
+  /* FGo: with -D, the deterministic steps depend on the distance bucket of
+     the seed. Seeds without distances are taken as mid-range. The stats of
+     the bucket are taken from here, so that they include the dinfer and
+     its stages below. */
+
+  if (dist_det)
+  {
+    if (seed_df_distance(queue_cur)[0] > 0)
+    {
+      double prob = get_seed_dist_prob(queue_cur);
+
+      if (prob <= DIST_DET_NEAR)
+        bucket = DIST_BUCKET_NEAR;
+      else if (prob > DIST_DET_FAR)
+        bucket = DIST_BUCKET_FAR;
+    }
+
+    bucket_seeds[bucket]++;
+    bucket_start_ms = get_cur_time();
+    memcpy(orig_stage_finds, stage_finds, sizeof(stage_finds));
+    memcpy(orig_stage_cycles, stage_cycles, sizeof(stage_cycles));
+  }
+
+  /* FGo: infer the distance-sensitive bytes of seeds close to the targets,
+     which havoc and splicing then favor. */
+
+  if (dist_grad && infer_dist_bytes(argv, out_buf, len))
+    goto abandon_entry;
+
+  dist_pos = queue_cur->dist_pos;
+  dist_pos_cnt = queue_cur->dist_pos_cnt;
+
+  /* FGo: with -I, try the comparison operands logged near the targets in
+     place of the input bytes they were read from. */
+
+  if (cmplog_mode && cmplog_stage(argv, out_buf, len))
+    goto abandon_entry;
+
+#endif // AFLGO_IMPL
+
   /* Skip right away if -d is given, if we have done deterministic fuzzing on
      this entry ourselves (was_fuzzed), or if it has gone through deterministic
      testing in earlier, resumed runs (passed_det). */
@@ -5879,6 +8098,11 @@ static u8 fuzz_one(char **argv)
   if (master_max && (queue_cur->exec_cksum % master_max) != master_id - 1)
     goto havoc_stage;
 
+#if AFLGO_IMPL
+  if (dist_det && bucket == DIST_BUCKET_FAR)
+    goto havoc_stage;
+#endif // AFLGO_IMPL
+
   doing_det = 1;
 
   /*********************************************
@@ -5893,6 +8117,19 @@ static u8 fuzz_one(char **argv)
     _arf[(_bf) >> 3] ^= (128 >> ((_bf) & 7)); \
   } while (0)
 
+#if AFLGO_IMPL
+
+  /* FGo: mid-range seeds start at the walking byte, which builds the
+     effector map. */
+
+  if (dist_det && bucket == DIST_BUCKET_MID)
+  {
+    new_hit_cnt = queued_paths + unique_crashes;
+    goto dist_det_sampled;
+  }
+
+#endif // AFLGO_IMPL
+
   /* Single walking bit. */
 
   stage_short = "flip1";
@@ -6069,6 +8306,10 @@ static u8 fuzz_one(char **argv)
   /* Initialize effector map for the next step (see comments below). Always
      flag first and last byte as doing something. */
 
+#if AFLGO_IMPL
+dist_det_sampled:
+#endif // AFLGO_IMPL
+
   eff_map = ck_alloc(EFF_ALEN(len));
   eff_map[0] = 1;
 
@@ -6144,6 +8385,18 @@ static u8 fuzz_one(char **argv)
 
   blocks_eff_total += EFF_ALEN(len);
 
+#if AFLGO_IMPL
+
+  /* FGo: mid-range seeds only get a sample of the effective bytes in the
+     next deterministic steps. */
+
+  if (dist_det && bucket == DIST_BUCKET_MID)
+    for (i = 0; i < EFF_ALEN(len); ++i)
+      if (eff_map[i] && UR(100) >= DIST_DET_SAMPLE)
+        eff_map[i] = 0;
+
+#endif // AFLGO_IMPL
+
   new_hit_cnt = queued_paths + unique_crashes;
 
   stage_finds[STAGE_FLIP8] += new_hit_cnt - orig_hit_cnt;
@@ -6773,7 +9026,14 @@ skip_interest:
          is redundant, or if its entire span has no bytes set in the effector
          map. */
 
+#if AFLGO_IMPL
+      /* FGo: only the nearest ones, when ordered by proximity. */
+
+      if ((extras_by_dist ? j >= MAX_DET_EXTRAS
+                          : extras_cnt > MAX_DET_EXTRAS && UR(extras_cnt) >= MAX_DET_EXTRAS) ||
+#else
       if ((extras_cnt > MAX_DET_EXTRAS && UR(extras_cnt) >= MAX_DET_EXTRAS) ||
+#endif // AFLGO_IMPL
           extras[j].len > len - i ||
           !memcmp(extras[j].data, out_buf + i, extras[j].len) ||
           !memchr(eff_map + EFF_APOS(i), 1, EFF_SPAN_ALEN(i, extras[j].len)))
@@ -6789,6 +9049,13 @@ skip_interest:
       if (common_fuzz_stuff(argv, out_buf, len))
         goto abandon_entry;
 
+#if AFLGO_IMPL
+      /* FGo: extras ordered by proximity are not sorted by size. */
+
+      if (extras_by_dist)
+        memcpy(out_buf + i, in_buf + i, last_len);
+#endif // AFLGO_IMPL
+
       stage_cur++;
     }
 
@@ -6820,7 +9087,11 @@ skip_interest:
     for (j = 0; j < extras_cnt; j++)
     {
 
+#if AFLGO_IMPL
+      if (len + extras[j].len > MAX_FILE || (extras_by_dist && j >= MAX_DET_EXTRAS))
+#else
       if (len + extras[j].len > MAX_FILE)
+#endif // AFLGO_IMPL
       {
         stage_max--;
         continue;
@@ -6922,6 +9193,11 @@ havoc_stage:
 
   stage_cur_byte = -1;
 
+#if AFLGO_IMPL
+  if (dist_det && !bucket_havoc_start_ms)
+    bucket_havoc_start_ms = get_cur_time();
+#endif // AFLGO_IMPL
+
   /* The havoc stage mutation code is also invoked when splicing files; if the
      splice_cycle variable is set, generate different descriptions and such. */
 
@@ -6982,7 +9258,7 @@ havoc_stage:
 
         /* Set byte to interesting value. */
 
-        out_buf[UR(temp_len)] = interesting_8[UR(sizeof(interesting_8))];
+        out_buf[UR_POS(temp_len)] = interesting_8[UR(sizeof(interesting_8))];
         break;
 
       case 2:
@@ -6995,13 +9271,13 @@ havoc_stage:
         if (UR(2))
         {
 
-          *(u16 *)(out_buf + UR(temp_len - 1)) =
+          *(u16 *)(out_buf + UR_POS(temp_len - 1)) =
               interesting_16[UR(sizeof(interesting_16) >> 1)];
         }
         else
         {
 
-          *(u16 *)(out_buf + UR(temp_len - 1)) = SWAP16(
+          *(u16 *)(out_buf + UR_POS(temp_len - 1)) = SWAP16(
               interesting_16[UR(sizeof(interesting_16) >> 1)]);
         }
 
@@ -7017,13 +9293,13 @@ havoc_stage:
         if (UR(2))
         {
 
-          *(u32 *)(out_buf + UR(temp_len - 3)) =
+          *(u32 *)(out_buf + UR_POS(temp_len - 3)) =
               interesting_32[UR(sizeof(interesting_32) >> 2)];
         }
         else
         {
 
-          *(u32 *)(out_buf + UR(temp_len - 3)) = SWAP32(
+          *(u32 *)(out_buf + UR_POS(temp_len - 3)) = SWAP32(
               interesting_32[UR(sizeof(interesting_32) >> 2)]);
         }
 
@@ -7033,14 +9309,14 @@ havoc_stage:
 
         /* Randomly subtract from byte. */
 
-        out_buf[UR(temp_len)] -= 1 + UR(ARITH_MAX);
+        out_buf[UR_POS(temp_len)] -= 1 + UR(ARITH_MAX);
         break;
 
       case 5:
 
         /* Randomly add to byte. */
 
-        out_buf[UR(temp_len)] += 1 + UR(ARITH_MAX);
+        out_buf[UR_POS(temp_len)] += 1 + UR(ARITH_MAX);
         break;
 
       case 6:
@@ -7053,14 +9329,14 @@ havoc_stage:
         if (UR(2))
         {
 
-          u32 pos = UR(temp_len - 1);
+          u32 pos = UR_POS(temp_len - 1);
 
           *(u16 *)(out_buf + pos) -= 1 + UR(ARITH_MAX);
         }
         else
         {
 
-          u32 pos = UR(temp_len - 1);
+          u32 pos = UR_POS(temp_len - 1);
           u16 num = 1 + UR(ARITH_MAX);
 
           *(u16 *)(out_buf + pos) =
@@ -7079,14 +9355,14 @@ havoc_stage:
         if (UR(2))
         {
 
-          u32 pos = UR(temp_len - 1);
+          u32 pos = UR_POS(temp_len - 1);
 
           *(u16 *)(out_buf + pos) += 1 + UR(ARITH_MAX);
         }
         else
         {
 
-          u32 pos = UR(temp_len - 1);
+          u32 pos = UR_POS(temp_len - 1);
           u16 num = 1 + UR(ARITH_MAX);
 
           *(u16 *)(out_buf + pos) =
@@ -7105,14 +9381,14 @@ havoc_stage:
         if (UR(2))
         {
 
-          u32 pos = UR(temp_len - 3);
+          u32 pos = UR_POS(temp_len - 3);
 
           *(u32 *)(out_buf + pos) -= 1 + UR(ARITH_MAX);
         }
         else
         {
 
-          u32 pos = UR(temp_len - 3);
+          u32 pos = UR_POS(temp_len - 3);
           u32 num = 1 + UR(ARITH_MAX);
 
           *(u32 *)(out_buf + pos) =
@@ -7131,14 +9407,14 @@ havoc_stage:
         if (UR(2))
         {
 
-          u32 pos = UR(temp_len - 3);
+          u32 pos = UR_POS(temp_len - 3);
 
           *(u32 *)(out_buf + pos) += 1 + UR(ARITH_MAX);
         }
         else
         {
 
-          u32 pos = UR(temp_len - 3);
+          u32 pos = UR_POS(temp_len - 3);
           u32 num = 1 + UR(ARITH_MAX);
 
           *(u32 *)(out_buf + pos) =
@@ -7153,7 +9429,7 @@ havoc_stage:
            why not. We use XOR with 1-255 to eliminate the
            possibility of a no-op. */
 
-        out_buf[UR(temp_len)] ^= 1 + UR(255);
+        out_buf[UR_POS(temp_len)] ^= 1 + UR(255);
         break;
 
       case 11 ... 12:
@@ -7247,7 +9523,7 @@ havoc_stage:
         copy_len = choose_block_len(temp_len - 1);
 
         copy_from = UR(temp_len - copy_len + 1);
-        copy_to = UR(temp_len - copy_len + 1);
+        copy_to = UR_POS(temp_len - copy_len + 1);
 
         if (UR(4))
         {
@@ -7283,7 +9559,7 @@ havoc_stage:
           if (extra_len > temp_len)
             break;
 
-          insert_at = UR(temp_len - extra_len + 1);
+          insert_at = UR_POS(temp_len - extra_len + 1);
           memcpy(out_buf + insert_at, a_extras[use_extra].data, extra_len);
         }
         else
@@ -7291,14 +9567,14 @@ havoc_stage:
 
           /* No auto extras or odds in our favor. Use the dictionary. */
 
-          u32 use_extra = UR(extras_cnt);
+          u32 use_extra = UR_EXTRA();
           u32 extra_len = extras[use_extra].len;
           u32 insert_at;
 
           if (extra_len > temp_len)
             break;
 
-          insert_at = UR(temp_len - extra_len + 1);
+          insert_at = UR_POS(temp_len - extra_len + 1);
           memcpy(out_buf + insert_at, extras[use_extra].data, extra_len);
         }
 
@@ -7334,7 +9610,7 @@ havoc_stage:
         else
         {
 
-          use_extra = UR(extras_cnt);
+          use_extra = UR_EXTRA();
           extra_len = extras[use_extra].len;
 
           if (temp_len + extra_len >= MAX_FILE)
@@ -7441,102 +9717,494 @@ retry_splicing:
       tid = UR(queued_paths);
     } while (tid == current_entry);
 
-    splicing_with = tid;
-    target = queue;
+    splicing_with = tid;
+    target = queue;
+
+    while (tid >= 100)
+    {
+      target = target->next_100;
+      tid -= 100;
+    }
+    while (tid--)
+      target = target->next;
+
+    /* Make sure that the target has a reasonable length. */
+
+#if AFLGO_IMPL
+    while (target && (target->len < 2 || target == queue_cur || target->retired))
+#else
+    while (target && (target->len < 2 || target == queue_cur))
+#endif // AFLGO_IMPL
+    {
+      target = target->next;
+      splicing_with++;
+    }
+
+    if (!target)
+      goto retry_splicing;
+
+    /* Read the testcase into a new buffer. */
+
+    fd = open(target->fname, O_RDONLY);
+
+    if (fd < 0)
+      PFATAL("Unable to open '%s'", target->fname);
+
+    new_buf = ck_alloc_nozero(target->len);
+
+    ck_read(fd, new_buf, target->len, target->fname);
+
+    close(fd);
+
+    /* Find a suitable splicing location, somewhere between the first and
+       the last differing byte. Bail out if the difference is just a single
+       byte or so. */
+
+    locate_diffs(in_buf, new_buf, MIN(len, target->len), &f_diff, &l_diff);
+
+    if (f_diff < 0 || l_diff < 2 || f_diff == l_diff)
+    {
+      ck_free(new_buf);
+      goto retry_splicing;
+    }
+
+    /* Split somewhere between the first and last differing byte. */
+
+#if AFLGO_IMPL
+    split_at = pick_dist_pos(f_diff, l_diff);
+#else
+    split_at = f_diff + UR(l_diff - f_diff);
+#endif // AFLGO_IMPL
+
+    /* Do the thing. */
+
+    len = target->len;
+    memcpy(new_buf, in_buf, split_at);
+    in_buf = new_buf;
+
+    ck_free(out_buf);
+    out_buf = ck_alloc_nozero(len);
+    memcpy(out_buf, in_buf, len);
+
+    goto havoc_stage;
+  }
+
+#endif /* !IGNORE_FINDS */
+
+  ret_val = 0;
+
+abandon_entry:
+
+  splicing_with = -1;
+
+  /* Update pending_not_fuzzed count if we made it through the calibration
+     cycle and have not seen this entry before. */
+
+  if (!stop_soon && !queue_cur->cal_failed && !queue_cur->was_fuzzed)
+  {
+    queue_cur->was_fuzzed = 1;
+    pending_not_fuzzed--;
+    if (queue_cur->favored)
+      pending_favored--;
+  }
+
+  munmap(orig_in, queue_cur->len);
+
+  if (in_buf != orig_in)
+    ck_free(in_buf);
+  ck_free(out_buf);
+  ck_free(eff_map);
+
+#if AFLGO_IMPL
+  dist_pos = NULL;
+  dist_pos_cnt = 0;
+
+  if (bucket_start_ms)
+  {
+    u64 end_ms = get_cur_time();
+
+    if (!bucket_havoc_start_ms)
+      bucket_havoc_start_ms = end_ms;
+
+    bucket_det_ms[bucket] += bucket_havoc_start_ms - bucket_start_ms;
+    bucket_havoc_ms[bucket] += end_ms - bucket_havoc_start_ms;
+
+    for (i = 0; i < 32; ++i)
+    {
+      bucket_finds[bucket][i] += stage_finds[i] - orig_stage_finds[i];
+      bucket_cycles[bucket][i] += stage_cycles[i] - orig_stage_cycles[i];
+    }
+  }
+#endif // AFLGO_IMPL
+
+  return ret_val;
+
+#undef FLIP_BIT
+}
+
+/* Grab interesting test cases from other fuzzers. */
+
+#if AFLGO_IMPL
+
+/* FGo: publish our min/max distances in <out_dir>/distance_extremes, so
+   that all the instances normalize the distances of their seeds alike. The
+   file is replaced atomically, as peers may read it at any time. */
+
+static void write_dist_extremes(void)
+{
+
+  u8 *fn = alloc_printf("%s/distance_extremes", out_dir);
+  u8 *tmp = alloc_printf("%s/.distance_extremes.tmp", out_dir);
+  u32 cnt = target_info.target_count;
+  s32 fd;
+
+  fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0)
+    PFATAL("Unable to create '%s'", tmp);
+
+  ck_write(fd, &cnt, sizeof(u32), tmp);
+  ck_write(fd, min_df_distance, cnt * sizeof(double), tmp);
+  ck_write(fd, max_df_distance, cnt * sizeof(double), tmp);
+  ck_write(fd, min_bt_distance, cnt * sizeof(double), tmp);
+  ck_write(fd, max_bt_distance, cnt * sizeof(double), tmp);
+
+  close(fd);
+
+  if (rename(tmp, fn))
+    PFATAL("Unable to rename '%s'", tmp);
+
+  ck_free(tmp);
+  ck_free(fn);
+}
+
+/* FGo: merge the min/max distances published by a peer into ours. Files
+   that are missing or were written for other targets are ignored. */
+
+static void read_peer_dist_extremes(u8 *peer)
+{
+
+  u8 *fn = alloc_printf("%s/%s/distance_extremes", sync_dir, peer);
+  u32 cnt = target_info.target_count;
+  double ext[4][FGO_TARGET_MAX_COUNT];
+  s32 fd = open(fn, O_RDONLY);
+  u32 peer_cnt;
+  u8 ok;
+
+  ck_free(fn);
+
+  if (fd < 0)
+    return;
+
+  ok = read(fd, &peer_cnt, sizeof(u32)) == sizeof(u32) && peer_cnt == cnt;
+
+  for (u32 k = 0; ok && k < 4; ++k)
+    ok = read(fd, ext[k], cnt * sizeof(double)) == cnt * sizeof(double);
+
+  close(fd);
+
+  if (!ok)
+    return;
+
+  for (u32 i = 0; i < cnt; ++i)
+  {
+    if (ext[0][i] > 0 && (min_df_distance[i] <= 0 || ext[0][i] < min_df_distance[i]))
+    {
+      min_df_distance[i] = ext[0][i];
+      dist_extreme_epoch++;
+    }
+    if (ext[1][i] > max_df_distance[i])
+    {
+      max_df_distance[i] = ext[1][i];
+      dist_extreme_epoch++;
+    }
+    if (ext[2][i] > 0 && (min_bt_distance[i] <= 0 || ext[2][i] < min_bt_distance[i]))
+    {
+      min_bt_distance[i] = ext[2][i];
+      dist_extreme_epoch++;
+    }
+    if (ext[3][i] > max_bt_distance[i])
+    {
+      max_bt_distance[i] = ext[3][i];
+      dist_extreme_epoch++;
+    }
+  }
+}
+
+/* FGo: tell from the index record of a peer's seed whether it is worth
+   importing. Returns 0 for seeds getting closer to some target than any of
+   ours, 2 for copies of our own test cases and for seeds in the far tail
+   for every target, which are not even executed, and 1 otherwise. */
+
+static u8 rank_sync_case(struct queue_index_rec *rec)
+{
+
+  u32 *tr = (u32 *)(rec + 1);
+  u32 cnt = target_info.target_count, i;
+
+  if (has_queue_cksum(rec->cksum))
+    return 2;
+
+  if (rec->target_count != cnt)
+    return 1;
+
+  for (i = 0; i < cnt; ++i)
+    if (tr[i] < min_tr_distance[i])
+      return 0;
+
+  /* Seeds that reach no target region at all tell nothing */
+
+  for (i = 0; i < cnt; ++i)
+    if (tr[i] != INT32_MAX)
+      break;
+  if (i == cnt)
+    return 1;
+
+  for (i = 0; i < cnt; ++i)
+    if (helper_get_quantile(&target_info, i, tr[i]) < DIST_SYNC_SKIP_QUANTILE)
+      return 1;
+
+  return 2;
+}
+
+/* FGo: get the state kept for a peer, adding it on first sight. */
+
+static struct sync_peer *get_sync_peer(u8 *name)
+{
+
+  struct sync_peer *sp;
+
+  for (sp = sync_peers; sp; sp = sp->next)
+    if (!strcmp(sp->name, name))
+      return sp;
+
+  sp = ck_alloc(sizeof(struct sync_peer));
+  sp->name = ck_strdup(name);
+  sp->next = sync_peers;
+  sync_peers = sp;
+
+  return sp;
+}
+
+/* FGo: check, without blocking, whether the index of some peer grew since
+   the last call. Without inotify, this is never the case, and syncing
+   happens every SYNC_INTERVAL fuzz_one() calls only. */
+
+static u8 sync_peers_updated(void)
+{
+
+  u8 buf[4096], updated = 0;
+
+  if (sync_inotify_fd < 0)
+    return 0;
+
+  while (read(sync_inotify_fd, buf, sizeof(buf)) > 0)
+    updated = 1;
+
+  return updated;
+}
+
+#endif // AFLGO_IMPL
+
+/* Run a test case found in the queue of another fuzzer, and keep it if it
+   is interesting. */
+
+static void sync_one_case(char **argv, u8 *path, u8 *party)
+{
+
+  s32 fd;
+  struct stat st;
+
+  /* Allow this to fail in case the other fuzzer is resuming or so... */
+
+  fd = open(path, O_RDONLY);
+
+  if (fd < 0)
+    return;
+
+  if (fstat(fd, &st))
+    PFATAL("fstat() failed");
+
+  /* Ignore zero-sized or oversized files. */
+
+  if (st.st_size && st.st_size <= MAX_FILE)
+  {
+
+    u8 fault;
+    u8 *mem = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (mem == MAP_FAILED)
+      PFATAL("Unable to mmap '%s'", path);
+
+    /* See what happens. We rely on save_if_interesting() to catch major
+       errors and save the test case. */
+
+    write_to_testcase(mem, st.st_size);
+
+    fault = run_target(argv, exec_tmout);
+
+    if (!stop_soon)
+    {
+
+      syncing_party = party;
+      queued_imported += save_if_interesting(argv, mem, st.st_size, fault);
+      syncing_party = 0;
+    }
+
+    munmap(mem, st.st_size);
+
+    if (!stop_soon && !(stage_cur++ % stats_update_freq))
+      show_stats();
+  }
+
+  close(fd);
+}
+
+#if AFLGO_IMPL
+
+/* FGo: import the seeds a peer appended to its queue index since the
+   position in *state, the ones getting closer to a target first. Returns 0
+   if the peer has no usable index, e.g. because it is not an FGo instance,
+   in which case its queue directory is scanned instead. */
+
+static u8 sync_from_index(char **argv, u8 *peer, u32 min_accept, u32 *next_min_accept,
+                          struct sync_index_state *state)
+{
+
+  struct sync_peer *sp = get_sync_peer(peer);
+  struct queue_index_rec **recs, *rec;
+  u8 *fn, *buf;
+  u32 rec_cnt = 0, pos = 0, size, max_id = 0;
+  struct stat st;
+  s32 fd;
+
+  if (sp->index_broken)
+    return 0;
+
+#ifdef __linux__
+  fn = alloc_printf("%s/%s/queue/.state", sync_dir, peer);
+  if (sync_inotify_fd >= 0)
+    inotify_add_watch(sync_inotify_fd, fn, IN_MODIFY);
+  ck_free(fn);
+#endif /* __linux__ */
 
-    while (tid >= 100)
-    {
-      target = target->next_100;
-      tid -= 100;
-    }
-    while (tid--)
-      target = target->next;
+  fn = alloc_printf("%s/%s/queue/.state/index", sync_dir, peer);
+  fd = open(fn, O_RDONLY);
+  ck_free(fn);
 
-    /* Make sure that the target has a reasonable length. */
+  if (fd < 0)
+    return 0;
 
-    while (target && (target->len < 2 || target == queue_cur))
-    {
-      target = target->next;
-      splicing_with++;
-    }
+  if (fstat(fd, &st))
+    PFATAL("fstat() failed");
 
-    if (!target)
-      goto retry_splicing;
+  /* Another or a shorter index means that the peer started over */
 
-    /* Read the testcase into a new buffer. */
+  if (st.st_ino != state->ino || st.st_size < state->pos)
+  {
+    state->pos = 0;
+    state->ino = st.st_ino;
+  }
 
-    fd = open(target->fname, O_RDONLY);
+  size = st.st_size - state->pos;
 
-    if (fd < 0)
-      PFATAL("Unable to open '%s'", target->fname);
+  if (!size)
+  {
+    close(fd);
+    return 1;
+  }
 
-    new_buf = ck_alloc_nozero(target->len);
+  buf = ck_alloc_nozero(size);
+  size = pread(fd, buf, size, state->pos);
+  close(fd);
 
-    ck_read(fd, new_buf, target->len, target->fname);
+  if ((s32)size < 0)
+    PFATAL("Unable to read the queue index of '%s'", peer);
 
-    close(fd);
+  /* Only complete records are taken, the rest is read again next time */
 
-    /* Find a suitable splicing location, somewhere between the first and
-       the last differing byte. Bail out if the difference is just a single
-       byte or so. */
+  recs = ck_alloc((size / sizeof(struct queue_index_rec) + 1) * sizeof(struct queue_index_rec *));
 
-    locate_diffs(in_buf, new_buf, MIN(len, target->len), &f_diff, &l_diff);
+  while (pos + sizeof(struct queue_index_rec) <= size)
+  {
+    rec = (struct queue_index_rec *)(buf + pos);
 
-    if (f_diff < 0 || l_diff < 2 || f_diff == l_diff)
+    if (rec->size < sizeof(struct queue_index_rec) + rec->target_count * sizeof(u32) + 4 ||
+        rec->size & 3)
     {
-      ck_free(new_buf);
-      goto retry_splicing;
+
+      /* Not worth stopping for: the queue directory is still there */
+
+      WARNF("Corrupted queue index of '%s', scanning its queue instead", peer);
+      sp->index_broken = 1;
+      state->pos = state->ino = 0;
+      ck_free(recs);
+      ck_free(buf);
+      return 0;
     }
 
-    /* Split somewhere between the first and last differing byte. */
+    if (pos + rec->size > size)
+      break;
 
-    split_at = f_diff + UR(l_diff - f_diff);
+    buf[pos + rec->size - 1] = 0;
 
-    /* Do the thing. */
+    /* A record of an entry seen before in this batch, written after
+       trimming, replaces the earlier one */
 
-    len = target->len;
-    memcpy(new_buf, in_buf, split_at);
-    in_buf = new_buf;
+    if (rec_cnt && rec->id <= max_id)
+      for (u32 i = rec_cnt; i > 0; --i)
+        if (recs[i - 1] && recs[i - 1]->id == rec->id)
+        {
+          recs[i - 1] = NULL;
+          break;
+        }
 
-    ck_free(out_buf);
-    out_buf = ck_alloc_nozero(len);
-    memcpy(out_buf, in_buf, len);
+    if (rec->id > max_id)
+      max_id = rec->id;
 
-    goto havoc_stage;
+    recs[rec_cnt++] = rec;
+    pos += rec->size;
   }
 
-#endif /* !IGNORE_FINDS */
-
-  ret_val = 0;
+  state->pos += pos;
 
-abandon_entry:
+  for (u8 r = 0; r < 2; ++r)
+    for (u32 i = 0; i < rec_cnt && !stop_soon; ++i)
+    {
+      u8 rank;
 
-  splicing_with = -1;
+      rec = recs[i];
+      if (!rec || rec->id < min_accept)
+        continue;
 
-  /* Update pending_not_fuzzed count if we made it through the calibration
-     cycle and have not seen this entry before. */
+      if (rec->id >= *next_min_accept)
+        *next_min_accept = rec->id + 1;
 
-  if (!stop_soon && !queue_cur->cal_failed && !queue_cur->was_fuzzed)
-  {
-    queue_cur->was_fuzzed = 1;
-    pending_not_fuzzed--;
-    if (queue_cur->favored)
-      pending_favored--;
-  }
+      rank = rank_sync_case(rec);
 
-  munmap(orig_in, queue_cur->len);
+      if (rank == 2)
+      {
+        sync_skipped++;
+        recs[i] = NULL;
+      }
+      else if (rank == r)
+      {
+        u8 *name = (u8 *)(rec + 1) + rec->target_count * sizeof(u32);
 
-  if (in_buf != orig_in)
-    ck_free(in_buf);
-  ck_free(out_buf);
-  ck_free(eff_map);
+        fn = alloc_printf("%s/%s/queue/%s", sync_dir, peer, name);
+        syncing_case = rec->id;
+        sync_one_case(argv, fn, peer);
+        ck_free(fn);
+        recs[i] = NULL;
+      }
+    }
 
-  return ret_val;
+  ck_free(recs);
+  ck_free(buf);
 
-#undef FLIP_BIT
+  return 1;
 }
 
-/* Grab interesting test cases from other fuzzers. */
+#endif // AFLGO_IMPL
 
 static void sync_fuzzers(char **argv)
 {
@@ -7552,6 +10220,15 @@ static void sync_fuzzers(char **argv)
   stage_max = stage_cur = 0;
   cur_depth = 0;
 
+#if AFLGO_IMPL
+  write_dist_extremes();
+
+#ifdef __linux__
+  if (sync_inotify_fd < 0)
+    sync_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif /* __linux__ */
+#endif // AFLGO_IMPL
+
   /* Look at the entries created for every other fuzzer in the sync directory. */
 
   while ((sd_ent = readdir(sd)))
@@ -7566,6 +10243,10 @@ static void sync_fuzzers(char **argv)
 
     s32 id_fd;
 
+#if AFLGO_IMPL
+    struct sync_index_state index_state = {0, 0};
+#endif // AFLGO_IMPL
+
     /* Skip dot files and our own output directory. */
 
     if (sd_ent->d_name[0] == '.' || !strcmp(sync_id, sd_ent->d_name))
@@ -7591,7 +10272,13 @@ static void sync_fuzzers(char **argv)
       PFATAL("Unable to create '%s'", qd_synced_path);
 
     if (read(id_fd, &min_accept, sizeof(u32)) > 0)
+    {
+#if AFLGO_IMPL
+      if (read(id_fd, &index_state, sizeof(index_state)) != sizeof(index_state))
+        memset(&index_state, 0, sizeof(index_state));
+#endif // AFLGO_IMPL
       lseek(id_fd, 0, SEEK_SET);
+    }
 
     next_min_accept = min_accept;
 
@@ -7602,15 +10289,25 @@ static void sync_fuzzers(char **argv)
     stage_cur = 0;
     stage_max = 0;
 
+#if AFLGO_IMPL
+
+    /* FGo: use the distances published by the peer, and tail its queue
+       index rather than scanning its queue directory, when it has one. */
+
+    read_peer_dist_extremes(sd_ent->d_name);
+
+    if (sync_from_index(argv, sd_ent->d_name, min_accept, &next_min_accept, &index_state))
+      goto sync_done;
+
+#endif // AFLGO_IMPL
+
     /* For every file queued by this fuzzer, parse ID and see if we have looked at
        it before; exec a test case if not. */
 
-    while ((qd_ent = readdir(qd)))
+    while ((qd_ent = readdir(qd)) && !stop_soon)
     {
 
       u8 *path;
-      s32 fd;
-      struct stat st;
 
       if (qd_ent->d_name[0] == '.' ||
           sscanf(qd_ent->d_name, CASE_PREFIX "%06u", &syncing_case) != 1 ||
@@ -7623,61 +10320,31 @@ static void sync_fuzzers(char **argv)
         next_min_accept = syncing_case + 1;
 
       path = alloc_printf("%s/%s", qd_path, qd_ent->d_name);
+      sync_one_case(argv, path, sd_ent->d_name);
+      ck_free(path);
+    }
 
-      /* Allow this to fail in case the other fuzzer is resuming or so... */
-
-      fd = open(path, O_RDONLY);
-
-      if (fd < 0)
-      {
-        ck_free(path);
-        continue;
-      }
-
-      if (fstat(fd, &st))
-        PFATAL("fstat() failed");
-
-      /* Ignore zero-sized or oversized files. */
-
-      if (st.st_size && st.st_size <= MAX_FILE)
-      {
-
-        u8 fault;
-        u8 *mem = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-
-        if (mem == MAP_FAILED)
-          PFATAL("Unable to mmap '%s'", path);
-
-        /* See what happens. We rely on save_if_interesting() to catch major
-           errors and save the test case. */
-
-        write_to_testcase(mem, st.st_size);
-
-        fault = run_target(argv, exec_tmout);
-
-        if (stop_soon)
-          return;
-
-        syncing_party = sd_ent->d_name;
-        queued_imported += save_if_interesting(argv, mem, st.st_size, fault);
-        syncing_party = 0;
-
-        munmap(mem, st.st_size);
+#if AFLGO_IMPL
+  sync_done:
+#endif // AFLGO_IMPL
 
-        if (!(stage_cur++ % stats_update_freq))
-          show_stats();
-      }
+    /* When stopped halfway, the last case is looked at again on resume. */
 
-      ck_free(path);
-      close(fd);
+    if (!stop_soon)
+    {
+      ck_write(id_fd, &next_min_accept, sizeof(u32), qd_synced_path);
+#if AFLGO_IMPL
+      ck_write(id_fd, &index_state, sizeof(index_state), qd_synced_path);
+#endif // AFLGO_IMPL
     }
 
-    ck_write(id_fd, &next_min_accept, sizeof(u32), qd_synced_path);
-
     close(id_fd);
     closedir(qd);
     ck_free(qd_path);
     ck_free(qd_synced_path);
+
+    if (stop_soon)
+      break;
   }
 
   closedir(sd);
@@ -7694,6 +10361,9 @@ static void handle_stop_sig(int sig)
     kill(child_pid, SIGKILL);
   if (forksrv_pid > 0)
     kill(forksrv_pid, SIGKILL);
+#if AFLGO_IMPL
+  fsrv_kill(&san_fsrv);
+#endif // AFLGO_IMPL
 }
 
 /* Handle skip request (SIGUSR1). */
@@ -7709,6 +10379,16 @@ static void handle_skipreq(int sig)
 static void handle_timeout(int sig)
 {
 
+#if AFLGO_IMPL
+
+  /* FGo: a replay through the sanitized binary, whose child or fork server
+     is the one to kill. */
+
+  if (fsrv_handle_timeout(&san_fsrv))
+    return;
+
+#endif // AFLGO_IMPL
+
   if (child_pid > 0)
   {
 
@@ -7999,7 +10679,26 @@ static void usage(u8 *argv0)
        "  -z schedule   - temperature-based power schedules\n"
        "                  {exp, log, lin, quad} (Default: exp)\n"
        "  -c min        - time from start when SA enters exploitation\n"
-       "                  in secs (s), mins (m), hrs (h), or days (d)\n\n"
+       "                  in secs (s), mins (m), hrs (h), or days (d)\n"
+       "  -q pct        - pick seeds by distance, with pct%% of the picks\n"
+       "                  walking the queue in order (Default: off)\n"
+       "  -P            - retire seeds far from all targets after -c time\n"
+       "  -G            - find the bytes moving the distances of close seeds\n"
+       "                  and focus havoc and splicing on them\n"
+       "  -D            - run deterministic steps on close seeds only,\n"
+       "                  and a sample of them on mid-range seeds\n"
+       "  -K            - trim seeds keeping their distances, rather than\n"
+       "                  their coverage\n"
+       "  -N            - also keep inputs getting closer to a target\n"
+       "                  without new coverage, tagged +dist\n"
+       "  -E            - favor the coverage of edges that can reach a\n"
+       "                  target, tagged +tcov when new\n"
+       "  -I            - input-to-state stage on seeds close to the targets,\n"
+       "                  from the comparisons logged in the code near them\n"
+       "  -A binary     - sanitized build of the target, replaying the inputs\n"
+       "                  reaching a target and the crashes or hangs\n"
+       "  -R factor     - factor applied to the weight of reached targets\n"
+       "                  in the seed energy, 0 to ignore them (Default: 1)\n\n"
 #endif // AFLGO_IMPL
 
        "Execution control settings:\n\n"
@@ -8109,6 +10808,22 @@ EXP_ST void setup_dirs_fds(void)
     PFATAL("Unable to create '%s'", tmp);
   ck_free(tmp);
 
+#if AFLGO_IMPL
+
+  /* FGo: index of the queue entries, tailed by syncing peers. */
+
+  if (sync_id)
+  {
+
+    tmp = alloc_printf("%s/queue/.state/index", out_dir);
+    queue_index_fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0600);
+    if (queue_index_fd < 0)
+      PFATAL("Unable to create '%s'", tmp);
+    ck_free(tmp);
+  }
+
+#endif // AFLGO_IMPL
+
   /* Sync directory for keeping track of cooperating fuzzers. */
 
   if (sync_id)
@@ -8136,6 +10851,17 @@ EXP_ST void setup_dirs_fds(void)
     PFATAL("Unable to create '%s'", tmp);
   ck_free(tmp);
 
+#if AFLGO_IMPL
+
+  /* FGo: the first seed reaching each target. */
+
+  tmp = alloc_printf("%s/targets", out_dir);
+  if (mkdir(tmp, 0700))
+    PFATAL("Unable to create '%s'", tmp);
+  ck_free(tmp);
+
+#endif // AFLGO_IMPL
+
   /* Generally useful file descriptors. */
 
   dev_null_fd = open("/dev/null", O_RDWR);
@@ -8723,7 +11449,7 @@ int main(int argc, char **argv)
   srandom(tv.tv_sec ^ tv.tv_usec ^ getpid());
 
 #if AFLGO_IMPL
-  while ((opt = getopt(argc, argv, "+i:o:f:m:t:T:dnCB:S:M:x:Qz:c:r:")) > 0)
+  while ((opt = getopt(argc, argv, "+i:o:f:m:t:T:dnCB:S:M:x:Qz:c:r:q:PR:GDKNEIA:")) > 0)
 #else
   while ((opt = getopt(argc, argv, "+i:o:f:m:t:T:dnCB:S:M:x:Q")) > 0)
 #endif // AFLGO_IMPL
@@ -8985,6 +11711,68 @@ int main(int argc, char **argv)
     }
     break;
 
+    case 'q': /* distance-prioritized scheduling */
+
+      if (sscanf(optarg, "%u", &dist_sched_explore) < 1 || optarg[0] == '-' ||
+          dist_sched_explore > 100)
+        FATAL("Bad syntax used for -q");
+
+      dist_sched = 1;
+      break;
+
+    case 'P': /* far-seed pruning */
+
+      dist_prune = 1;
+      break;
+
+    case 'D': /* distance-conditional deterministic steps */
+
+      dist_det = 1;
+      break;
+
+    case 'N': /* distance novelty */
+
+      dist_novelty = 1;
+      break;
+
+    case 'E': /* target-region coverage */
+
+      reach_cov = 1;
+      break;
+
+    case 'I': /* input-to-state stage */
+
+      cmplog_mode = 1;
+      break;
+
+    case 'A': /* sanitized binary */
+
+      if (san_path)
+        FATAL("Multiple -A options not supported");
+      san_path = optarg;
+
+      if (access(san_path, X_OK))
+        PFATAL("Unable to access the sanitized binary '%s'", san_path);
+      break;
+
+    case 'K': /* directed trimming */
+
+      dist_trim = 1;
+      break;
+
+    case 'G': /* distance-gradient inference */
+
+      dist_grad = 1;
+      break;
+
+    case 'R': /* weight of reached targets */
+
+      if (sscanf(optarg, "%lf", &reached_weight) < 1 || optarg[0] == '-' ||
+          reached_weight > 1.0)
+        FATAL("Bad syntax used for -R");
+
+      break;
+
 #endif // AFLGO_IMPL
 
     default:
@@ -9054,6 +11842,11 @@ int main(int argc, char **argv)
   if (dumb_mode == 2 && no_forkserver)
     FATAL("AFL_DUMB_FORKSRV and AFL_NO_FORKSRV are mutually exclusive");
 
+#if AFLGO_IMPL
+  if (san_path && (dumb_mode || no_forkserver || qemu_mode))
+    FATAL("-A needs the fork servers of instrumented binaries");
+#endif // AFLGO_IMPL
+
   if (getenv("AFL_PRELOAD"))
   {
     setenv("LD_PRELOAD", getenv("AFL_PRELOAD"), 1);
@@ -9101,6 +11894,20 @@ int main(int argc, char **argv)
 
   check_binary(argv[optind]);
 
+#if AFLGO_IMPL
+
+  /* FGo: the reach mask and the dictionary are read from the binary. */
+
+  if (reach_cov)
+    load_reach_mask();
+
+  load_target_dict();
+
+  if (extras_by_dist)
+    sort_extras_by_dist();
+
+#endif // AFLGO_IMPL
+
   start_time = get_cur_time();
 
   if (qemu_mode)
@@ -9108,6 +11915,25 @@ int main(int argc, char **argv)
   else
     use_argv = argv + optind;
 
+#if AFLGO_IMPL
+
+  /* FGo: the sanitized binary takes the same arguments. */
+
+  if (san_path)
+  {
+
+    u32 i = 0;
+
+    while (use_argv[i])
+      i++;
+
+    san_argv = ck_alloc((i + 1) * sizeof(char *));
+    memcpy(san_argv, use_argv, i * sizeof(char *));
+    san_argv[0] = san_path;
+  }
+
+#endif // AFLGO_IMPL
+
   perform_dry_run(use_argv);
 
   cull_queue();
@@ -9178,16 +12004,37 @@ int main(int argc, char **argv)
 
       prev_queued = queued_paths;
 
+#if AFLGO_IMPL
+      prune_far_seeds();
+#endif // AFLGO_IMPL
+
       if (sync_id && queue_cycle == 1 && getenv("AFL_IMPORT_FIRST"))
         sync_fuzzers(use_argv);
     }
 
+#if AFLGO_IMPL
+
+    /* FGo: with distance-prioritized scheduling, a cycle is as many picks
+       as there are seeds. */
+
+    if (dist_sched)
+    {
+      queue_cur = dist_sched_next();
+      current_entry = queue_cur->dist_id;
+    }
+
+#endif // AFLGO_IMPL
+
     skipped_fuzz = fuzz_one(use_argv);
 
     if (!stop_soon && sync_id && !skipped_fuzz)
     {
 
+#if AFLGO_IMPL
+      if (!(sync_interval_cnt++ % SYNC_INTERVAL) || sync_peers_updated())
+#else
       if (!(sync_interval_cnt++ % SYNC_INTERVAL))
+#endif // AFLGO_IMPL
         sync_fuzzers(use_argv);
     }
 
@@ -9197,6 +12044,20 @@ int main(int argc, char **argv)
     if (stop_soon)
       break;
 
+#if AFLGO_IMPL
+
+    if (dist_sched)
+    {
+      if (++dist_sched_cnt >= queued_paths)
+      {
+        dist_sched_cnt = 0;
+        queue_cur = NULL;
+      }
+      continue;
+    }
+
+#endif // AFLGO_IMPL
+
     queue_cur = queue_cur->next;
     current_entry++;
   }
@@ -9212,7 +12073,14 @@ int main(int argc, char **argv)
       kill(child_pid, SIGKILL);
     if (forksrv_pid > 0)
       kill(forksrv_pid, SIGKILL);
+#if AFLGO_IMPL
+    fsrv_kill(&san_fsrv);
+#endif // AFLGO_IMPL
   }
+#if AFLGO_IMPL
+  if (san_fsrv.pid > 0)
+    waitpid(san_fsrv.pid, NULL, 0);
+#endif // AFLGO_IMPL
   /* Now that we've killed the forkserver, we wait for it to be able to get rusage stats. */
   if (waitpid(forksrv_pid, NULL, 0) <= 0)
   {
@@ -36,6 +36,7 @@
 #include "debug.h"
 #include "alloc-inl.h"
 #include "hash.h"
+#include "forkserver.h"
 
 #include <stdio.h>
 #include <unistd.h>
@@ -56,6 +57,8 @@
 
 static s32 child_pid;                 /* PID of the tested program         */
 
+static struct fsrv fsrv;              /* Fork server of the target         */
+
 static u8* trace_bits;                /* SHM with instrumentation bitmap   */
 
 static u8 *out_file,                  /* Trace output file                 */
@@ -73,7 +76,8 @@ static u8  quiet_mode,                /* Hide non-essential messages?      */
            edges_only,                /* Ignore hit counts?                */
            cmin_mode,                 /* Generate output in afl-cmin mode? */
            binary_mode,               /* Write output as a binary map      */
-           keep_cores;                /* Allow coredumps?                  */
+           keep_cores,                /* Allow coredumps?                  */
+           use_forkserver;            /* Run through a fork server?        */
 
 static volatile u8
            stop_soon,                 /* Ctrl-C pressed?                   */
@@ -149,7 +153,11 @@ static void setup_shm(void) {
 
   u8* shm_str;
 
+#if AFLGO_IMPL
+  shm_id = shmget(IPC_PRIVATE, FGO_AREA_SIZE, IPC_CREAT | IPC_EXCL | 0600);
+#else
   shm_id = shmget(IPC_PRIVATE, MAP_SIZE, IPC_CREAT | IPC_EXCL | 0600);
+#endif // AFLGO_IMPL
 
   if (shm_id < 0) PFATAL("shmget() failed");
 
@@ -239,6 +247,8 @@ static u32 write_results(void) {
 
 static void handle_timeout(int sig) {
 
+  if (fsrv_handle_timeout(&fsrv)) return;
+
   child_timed_out = 1;
   if (child_pid > 0) kill(child_pid, SIGKILL);
 
@@ -255,79 +265,126 @@ static void run_target(char** argv) {
   if (!quiet_mode)
     SAYF("-- Program output begins --\n" cRST);
 
+#if AFLGO_IMPL
+  dist_region_reset(trace_bits + MAP_SIZE);
+#endif // AFLGO_IMPL
+
   MEM_BARRIER();
 
-  child_pid = fork();
+  if (use_forkserver) {
 
-  if (child_pid < 0) PFATAL("fork() failed");
+    s32 fd = quiet_mode ? open("/dev/null", O_RDWR) : -1;
 
-  if (!child_pid) {
+    if (quiet_mode && fd < 0) PFATAL("Unable to open /dev/null");
 
-    struct rlimit r;
+    fsrv.target_path = target_path;
+    fsrv.argv        = argv;
+    fsrv.trace_bits  = trace_bits;
+    fsrv.mem_limit   = mem_limit;
+    fsrv.in_fd       = -1;
+    fsrv.out_fd      = fd;
+    fsrv.keep_cores  = keep_cores;
 
-    if (quiet_mode) {
+    if (!fsrv_start(&fsrv, exec_tmout * FORK_WAIT_MULT)) {
 
-      s32 fd = open("/dev/null", O_RDWR);
+      if (*(u32*)trace_bits == EXEC_FAIL_SIG)
+        FATAL("Unable to execute '%s'", argv[0]);
 
-      if (fd < 0 || dup2(fd, 1) < 0 || dup2(fd, 2) < 0) {
-        *(u32*)trace_bits = EXEC_FAIL_SIG;
-        PFATAL("Descriptor initialization failed");
-      }
+      if (fsrv.timed_out)
+        FATAL("Timeout while initializing fork server (adjusting -t may help)");
 
-      close(fd);
+      if (mem_limit)
+        FATAL("Fork server handshake failed (a higher -m limit may help)");
+
+      FATAL("Fork server handshake failed");
 
     }
 
-    if (mem_limit) {
+    if (fd >= 0) close(fd);
+
+    if (!fsrv_run(&fsrv, exec_tmout, &status) && !stop_soon)
+      FATAL("Unable to communicate with fork server (OOM?)");
 
-      r.rlim_max = r.rlim_cur = ((rlim_t)mem_limit) << 20;
+    child_timed_out = fsrv.timed_out;
+
+    fsrv_kill(&fsrv);
+    waitpid(fsrv.pid, NULL, 0);
+
+  } else {
+
+    child_pid = fork();
+
+    if (child_pid < 0) PFATAL("fork() failed");
+
+    if (!child_pid) {
+
+      struct rlimit r;
+
+      if (quiet_mode) {
+
+        s32 fd = open("/dev/null", O_RDWR);
+
+        if (fd < 0 || dup2(fd, 1) < 0 || dup2(fd, 2) < 0) {
+          *(u32*)trace_bits = EXEC_FAIL_SIG;
+          PFATAL("Descriptor initialization failed");
+        }
+
+        close(fd);
+
+      }
+
+      if (mem_limit) {
+
+        r.rlim_max = r.rlim_cur = ((rlim_t)mem_limit) << 20;
 
 #ifdef RLIMIT_AS
 
-      setrlimit(RLIMIT_AS, &r); /* Ignore errors */
+        setrlimit(RLIMIT_AS, &r); /* Ignore errors */
 
 #else
 
-      setrlimit(RLIMIT_DATA, &r); /* Ignore errors */
+        setrlimit(RLIMIT_DATA, &r); /* Ignore errors */
 
 #endif /* ^RLIMIT_AS */
 
-    }
+      }
 
-    if (!keep_cores) r.rlim_max = r.rlim_cur = 0;
-    else r.rlim_max = r.rlim_cur = RLIM_INFINITY;
+      if (!keep_cores) r.rlim_max = r.rlim_cur = 0;
+      else r.rlim_max = r.rlim_cur = RLIM_INFINITY;
 
-    setrlimit(RLIMIT_CORE, &r); /* Ignore errors */
+      setrlimit(RLIMIT_CORE, &r); /* Ignore errors */
 
-    if (!getenv("LD_BIND_LAZY")) setenv("LD_BIND_NOW", "1", 0);
+      if (!getenv("LD_BIND_LAZY")) setenv("LD_BIND_NOW", "1", 0);
 
-    setsid();
+      setsid();
 
-    execv(target_path, argv);
+      execv(target_path, argv);
 
-    *(u32*)trace_bits = EXEC_FAIL_SIG;
-    exit(0);
+      *(u32*)trace_bits = EXEC_FAIL_SIG;
+      exit(0);
 
-  }
+    }
 
-  /* Configure timeout, wait for child, cancel timeout. */
+    /* Configure timeout, wait for child, cancel timeout. */
 
-  if (exec_tmout) {
+    if (exec_tmout) {
 
-    child_timed_out = 0;
-    it.it_value.tv_sec = (exec_tmout / 1000);
-    it.it_value.tv_usec = (exec_tmout % 1000) * 1000;
+      child_timed_out = 0;
+      it.it_value.tv_sec = (exec_tmout / 1000);
+      it.it_value.tv_usec = (exec_tmout % 1000) * 1000;
 
-  }
+    }
 
-  setitimer(ITIMER_REAL, &it, NULL);
+    setitimer(ITIMER_REAL, &it, NULL);
 
-  if (waitpid(child_pid, &status, 0) <= 0) FATAL("waitpid() failed");
+    if (waitpid(child_pid, &status, 0) <= 0) FATAL("waitpid() failed");
 
-  child_pid = 0;
-  it.it_value.tv_sec = 0;
-  it.it_value.tv_usec = 0;
-  setitimer(ITIMER_REAL, &it, NULL);
+    child_pid = 0;
+    it.it_value.tv_sec = 0;
+    it.it_value.tv_usec = 0;
+    setitimer(ITIMER_REAL, &it, NULL);
+
+  }
 
   MEM_BARRIER();
 
@@ -367,6 +424,7 @@ static void handle_stop_sig(int sig) {
   stop_soon = 1;
 
   if (child_pid > 0) kill(child_pid, SIGKILL);
+  fsrv_kill(&fsrv);
 
 }
 
@@ -772,6 +830,8 @@ int main(int argc, char** argv) {
   else
     use_argv = argv + optind;
 
+  use_forkserver = !qemu_mode && fsrv_wanted(target_path);
+
   run_target(use_argv);
 
   tcnt = write_results();
@@ -781,6 +841,10 @@ int main(int argc, char** argv) {
     if (!tcnt) FATAL("No instrumentation detected" cRST);
     OKF("Captured %u tuples in '%s'." cRST, tcnt, out_file);
 
+#if AFLGO_IMPL
+    dist_region_show(trace_bits + MAP_SIZE);
+#endif // AFLGO_IMPL
+
   }
 
   exit(child_crashed * 2 + child_timed_out);
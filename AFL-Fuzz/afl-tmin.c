@@ -34,6 +34,7 @@
 #include "debug.h"
 #include "alloc-inl.h"
 #include "hash.h"
+#include "forkserver.h"
 
 #include <stdio.h>
 #include <unistd.h>
@@ -54,6 +55,8 @@
 
 static s32 child_pid;                 /* PID of the tested program         */
 
+static struct fsrv fsrv;              /* Fork server of the target         */
+
 static u8 *trace_bits,                /* SHM with instrumentation bitmap   */
           *mask_bitmap;               /* Mask for trace bits (-B)          */
 
@@ -82,7 +85,8 @@ static u8  crash_mode,                /* Crash-centric mode?               */
            exit_crash,                /* Treat non-zero exit as crash?     */
            edges_only,                /* Ignore hit counts?                */
            exact_mode,                /* Require path match for crashes?   */
-           use_stdin = 1;             /* Use stdin for program input?      */
+           use_stdin = 1,             /* Use stdin for program input?      */
+           use_forkserver;            /* Run through a fork server?        */
 
 static volatile u8
            stop_soon,                 /* Ctrl-C pressed?                   */
@@ -179,8 +183,7 @@ static void setup_shm(void) {
   u8* shm_str;
 
 #if AFLGO_IMPL
-  // Allocate 16 more bytes (used by afl-fuzz distances)
-  shm_id = shmget(IPC_PRIVATE, MAP_SIZE + 16, IPC_CREAT | IPC_EXCL | 0600);
+  shm_id = shmget(IPC_PRIVATE, FGO_AREA_SIZE, IPC_CREAT | IPC_EXCL | 0600);
 #else
   shm_id = shmget(IPC_PRIVATE, MAP_SIZE, IPC_CREAT | IPC_EXCL | 0600);
 #endif // AFLGO_IMPL
@@ -254,12 +257,55 @@ static s32 write_to_file(u8* path, u8* mem, u32 len) {
 
 static void handle_timeout(int sig) {
 
+  if (fsrv_handle_timeout(&fsrv)) return;
+
   child_timed_out = 1;
   if (child_pid > 0) kill(child_pid, SIGKILL);
 
 }
 
 
+/* Kill the fork server and a stopped persistent child (atexit handler). */
+
+static void kill_forkserver(void) {
+
+  fsrv_kill(&fsrv);
+
+}
+
+
+/* Spin up the fork server of the target, through the client shared with
+   afl-fuzz. Test cases on stdin then come through a prog_in fd it keeps. */
+
+static void init_forkserver(char** argv) {
+
+  fsrv.target_path = target_path;
+  fsrv.argv        = argv;
+  fsrv.trace_bits  = trace_bits;
+  fsrv.mem_limit   = mem_limit;
+  fsrv.in_fd       = use_stdin ? write_to_file(prog_in, in_data, 0) : dev_null_fd;
+  fsrv.out_fd      = dev_null_fd;
+
+  if (!fsrv_start(&fsrv, exec_tmout * FORK_WAIT_MULT)) {
+
+    if (fsrv.timed_out)
+      FATAL("Timeout while initializing fork server (adjusting -t may help)");
+
+    if (*(u32*)trace_bits == EXEC_FAIL_SIG)
+      FATAL("Unable to execute '%s'", argv[0]);
+
+    if (mem_limit)
+      FATAL("Fork server handshake failed (a higher -m limit may help)");
+
+    FATAL("Fork server handshake failed");
+
+  }
+
+  atexit(kill_forkserver);
+
+}
+
+
 /* Execute target application. Returns 0 if the changes are a dud, or
    1 if they should be kept. */
 
@@ -271,76 +317,104 @@ static u8 run_target(char** argv, u8* mem, u32 len, u8 first_run) {
   s32 prog_in_fd;
   u32 cksum;
 
+  /* The runtime marks the map once when attaching it, so the fork server
+     has to be up before the map is cleared. */
+
+  if (use_forkserver && !fsrv.pid) init_forkserver(argv);
+
   memset(trace_bits, 0, MAP_SIZE);
+#if AFLGO_IMPL
+  dist_region_reset(trace_bits + MAP_SIZE);
+#endif // AFLGO_IMPL
   MEM_BARRIER();
 
-  prog_in_fd = write_to_file(prog_in, mem, len);
+  if (use_forkserver) {
 
-  child_pid = fork();
+    if (use_stdin) {
 
-  if (child_pid < 0) PFATAL("fork() failed");
+      lseek(fsrv.in_fd, 0, SEEK_SET);
+      ck_write(fsrv.in_fd, mem, len, prog_in);
+      if (ftruncate(fsrv.in_fd, len)) PFATAL("ftruncate() failed");
+      lseek(fsrv.in_fd, 0, SEEK_SET);
 
-  if (!child_pid) {
+    } else close(write_to_file(prog_in, mem, len));
 
-    struct rlimit r;
+    if (!fsrv_run(&fsrv, exec_tmout, &status) && !stop_soon)
+      FATAL("Unable to communicate with fork server (OOM?)");
 
-    if (dup2(use_stdin ? prog_in_fd : dev_null_fd, 0) < 0 ||
-        dup2(dev_null_fd, 1) < 0 ||
-        dup2(dev_null_fd, 2) < 0) {
+    child_timed_out = fsrv.timed_out;
 
-      *(u32*)trace_bits = EXEC_FAIL_SIG;
-      PFATAL("dup2() failed");
+  } else {
 
-    }
+    prog_in_fd = write_to_file(prog_in, mem, len);
 
-    close(dev_null_fd);
-    close(prog_in_fd);
+    child_pid = fork();
+
+    if (child_pid < 0) PFATAL("fork() failed");
+
+    if (!child_pid) {
+
+      struct rlimit r;
+
+      if (dup2(use_stdin ? prog_in_fd : dev_null_fd, 0) < 0 ||
+          dup2(dev_null_fd, 1) < 0 ||
+          dup2(dev_null_fd, 2) < 0) {
+
+        *(u32*)trace_bits = EXEC_FAIL_SIG;
+        PFATAL("dup2() failed");
 
-    setsid();
+      }
+
+      close(dev_null_fd);
+      close(prog_in_fd);
 
-    if (mem_limit) {
+      setsid();
 
-      r.rlim_max = r.rlim_cur = ((rlim_t)mem_limit) << 20;
+      if (mem_limit) {
+
+        r.rlim_max = r.rlim_cur = ((rlim_t)mem_limit) << 20;
 
 #ifdef RLIMIT_AS
 
-      setrlimit(RLIMIT_AS, &r); /* Ignore errors */
+        setrlimit(RLIMIT_AS, &r); /* Ignore errors */
 
 #else
 
-      setrlimit(RLIMIT_DATA, &r); /* Ignore errors */
+        setrlimit(RLIMIT_DATA, &r); /* Ignore errors */
 
 #endif /* ^RLIMIT_AS */
 
-    }
+      }
 
-    r.rlim_max = r.rlim_cur = 0;
-    setrlimit(RLIMIT_CORE, &r); /* Ignore errors */
+      r.rlim_max = r.rlim_cur = 0;
+      setrlimit(RLIMIT_CORE, &r); /* Ignore errors */
 
-    execv(target_path, argv);
+      execv(target_path, argv);
 
-    *(u32*)trace_bits = EXEC_FAIL_SIG;
-    exit(0);
+      *(u32*)trace_bits = EXEC_FAIL_SIG;
+      exit(0);
 
-  }
+    }
+
+    close(prog_in_fd);
 
-  close(prog_in_fd);
+    /* Configure timeout, wait for child, cancel timeout. */
 
-  /* Configure timeout, wait for child, cancel timeout. */
+    child_timed_out = 0;
+    it.it_value.tv_sec = (exec_tmout / 1000);
+    it.it_value.tv_usec = (exec_tmout % 1000) * 1000;
 
-  child_timed_out = 0;
-  it.it_value.tv_sec = (exec_tmout / 1000);
-  it.it_value.tv_usec = (exec_tmout % 1000) * 1000;
+    setitimer(ITIMER_REAL, &it, NULL);
 
-  setitimer(ITIMER_REAL, &it, NULL);
+    if (waitpid(child_pid, &status, 0) <= 0) FATAL("waitpid() failed");
 
-  if (waitpid(child_pid, &status, 0) <= 0) FATAL("waitpid() failed");
+    child_pid = 0;
+    it.it_value.tv_sec = 0;
+    it.it_value.tv_usec = 0;
 
-  child_pid = 0;
-  it.it_value.tv_sec = 0;
-  it.it_value.tv_usec = 0;
+    setitimer(ITIMER_REAL, &it, NULL);
 
-  setitimer(ITIMER_REAL, &it, NULL);
+  }
 
   MEM_BARRIER();
 
@@ -672,6 +746,7 @@ static void handle_stop_sig(int sig) {
   stop_soon = 1;
 
   if (child_pid > 0) kill(child_pid, SIGKILL);
+  fsrv_kill(&fsrv);
 
 }
 
@@ -1128,6 +1203,8 @@ int main(int argc, char** argv) {
   else
     use_argv = argv + optind;
 
+  use_forkserver = !qemu_mode && fsrv_wanted(target_path);
+
   exact_mode = !!getenv("AFL_TMIN_EXACT");
 
   SAYF("\n");
@@ -1142,6 +1219,10 @@ int main(int argc, char** argv) {
   if (child_timed_out)
     FATAL("Target binary times out (adjusting -t may help).");
 
+#if AFLGO_IMPL
+  dist_region_show(trace_bits + MAP_SIZE);
+#endif // AFLGO_IMPL
+
   if (!crash_mode) {
 
      OKF("Program terminates normally, minimizing in " 
@@ -1158,6 +1239,16 @@ int main(int argc, char** argv) {
 
   minimize(use_argv);
 
+#if AFLGO_IMPL
+
+  /* Show how close the minimized input still gets to the targets. */
+
+  ACTF("Distances of the minimized input:");
+  run_target(use_argv, in_data, in_len, 0);
+  dist_region_show(trace_bits + MAP_SIZE);
+
+#endif // AFLGO_IMPL
+
   ACTF("Writing output to '%s'...", out_file);
 
   unlink(prog_in);
@@ -0,0 +1,78 @@
+/*
+   FGo - comparison logging
+   ------------------------
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Layout of the shared memory table in which the instrumentation of the
+   blocks with a DF distance logs the operands of integer comparisons and of
+   strcmp()/memcmp()-style calls. afl-fuzz only turns the logging on for the
+   runs of its input-to-state stage (-I), so the other runs just pay for a
+   call and a check per comparison near the targets.
+
+*/
+
+#ifndef _HAVE_CMPLOG_H
+#define _HAVE_CMPLOG_H
+
+#include "types.h"
+
+/* Environment variable used to pass the SHM ID of the table: */
+
+#define CMPLOG_SHM_ENV_VAR  "__FGO_CMPLOG_SHM_ID"
+
+/* Comparison slots, indexed by a random ID chosen by the pass, and the
+   number of executions of a slot logged in a run: */
+
+#define CMP_MAP_W           4096
+#define CMP_MAP_H           8
+
+/* Bytes logged for each operand of a routine: */
+
+#define CMP_RTN_LEN         32
+
+/* Length passed for the routines bounded by the terminator only, such as
+   strcmp(), as opposed to a length of 0: */
+
+#define CMP_RTN_UNBOUNDED   0xffffffffffffffffULL
+
+/* Kinds of comparisons: */
+
+#define CMP_TYPE_INS        0
+#define CMP_TYPE_RTN        1
+
+struct cmp_header
+{
+  u32 hits; /* Executions in the last run       */
+  u8 type;  /* CMP_TYPE_*                       */
+  u8 size;  /* Operand size, or bytes logged    */
+};
+
+struct cmp_operands
+{
+  u64 v0, v1;
+};
+
+struct cmp_rtn_operands
+{
+  u8 v0[CMP_RTN_LEN], v1[CMP_RTN_LEN];
+};
+
+union cmp_log
+{
+  struct cmp_operands ops[CMP_MAP_H];
+  struct cmp_rtn_operands rtn[CMP_MAP_H];
+};
+
+struct cmp_map
+{
+  u32 active;                           /* Set by afl-fuzz to log a run      */
+  struct cmp_header headers[CMP_MAP_W]; /* Reset by afl-fuzz before a run    */
+  union cmp_log log[CMP_MAP_W];
+};
+
+#endif /* ! _HAVE_CMPLOG_H */
@@ -30,6 +30,72 @@
 
 #define MAX_FACTOR 32
 
+/* Distance-prioritized scheduling (-q): default percentage of picks that
+   walk the queue in order instead, and how much the key of a seed grows
+   each time the scheduler picks it (keys of fresh seeds are in [0, 1]): */
+
+#define DIST_SCHED_EXPLORE      10
+#define DIST_SCHED_PICK_PENALTY 0.05
+
+/* Far-seed pruning (-P): a seed is a candidate for retirement once the
+   quantile of its transitional distance is at least DIST_PRUNE_QUANTILE for
+   every target. It is then retired with a probability of
+   2^(DIST_PRUNE_STEEPNESS * (rank - 1)), rank being its position among the
+   live seeds ordered by distance, from 0 (closest) to 1 (farthest): */
+
+#define DIST_PRUNE_QUANTILE     0.9
+#define DIST_PRUNE_STEEPNESS    8.0
+
+/* Sync: seeds of peers whose transitional distance quantile is at least
+   this for every target are not even executed: */
+
+#define DIST_SYNC_SKIP_QUANTILE 0.95
+
+/* Distance-gradient inference (-G): seeds of at most DIST_GRAD_MAX_LEN bytes
+   and with a directed energy part of at most DIST_GRAD_MAX_PROB get each of
+   their bytes flipped once, to find the ones moving the distances. Havoc
+   and splicing then pick one of these bytes DIST_GRAD_BIAS% of the time: */
+
+#define DIST_GRAD_MAX_LEN       1024
+#define DIST_GRAD_MAX_PROB      0.3
+#define DIST_GRAD_BIAS          50
+
+/* Distance-conditional deterministic stages (-D): seeds with a directed
+   energy part of at most DIST_DET_NEAR get all the deterministic steps,
+   seeds of at most DIST_DET_FAR skip the 1, 2 and 4-bit flips and get
+   DIST_DET_SAMPLE% of the bytes of their effector map, others get none: */
+
+#define DIST_DET_NEAR           0.2
+#define DIST_DET_FAR            0.6
+#define DIST_DET_SAMPLE         25
+
+/* Distance novelty (-N): at most this many inputs per minute are kept only
+   for getting closer to a target, without new coverage: */
+
+#define DIST_NOVELTY_PER_MIN    10
+
+/* Target-region coverage (-E): on edges that can reach a target, the speed
+   x size factor of a top_rated[] contender is scaled by this bias plus its
+   distance probability, so closer seeds win them even if a bit slower: */
+
+#define REACH_FAV_BIAS          0.25
+
+/* Input-to-state stage (-I): seeds up to this distance probability and
+   length go through it once, with at most this many runs to colorize them
+   and to try the logged operands, and routine operands need to match this
+   many bytes at least: */
+
+#define CMPLOG_MAX_PROB         0.3
+#define CMPLOG_MAX_LEN          4096
+#define CMPLOG_COLOR_EXECS      512
+#define CMPLOG_MAX_EXECS        4096
+#define CMPLOG_RTN_MIN_MATCH    2
+
+/* Sanitized replays (-A) get the timeout multiplied by this, for the
+   slowdown of the sanitizer: */
+
+#define SAN_TMOUT_MULT          3
+
 #endif // AFLGO_IMPL
 
 /* Version string: */
@@ -284,6 +350,20 @@
 
 #define SHM_ENV_VAR         "__AFL_SHM_ID"
 
+/* Environment variable used to pass the SHM ID of the test case buffer
+   (AFL_SHM_FUZZ). The segment holds a 4-byte length followed by up to
+   MAX_FILE bytes of data: */
+
+#define SHM_FUZZ_ENV_VAR    "__AFL_SHM_FUZZ_ID"
+
+/* Options advertised by the runtime in the fork server "hello" message. The
+   fuzzer replies with the subset of option bits it accepts, and then sends
+   the test case length after every request: */
+
+#define FS_OPT_ENABLED      0x80000000
+#define FS_OPT_SHDMEM_FUZZ  0x01000000
+#define FS_OPT_SHDMEM_STDIN 0x02000000
+
 /* Other less interesting, internal-only variables. */
 
 #define CLANG_ENV_VAR       "__AFL_CLANG_MODE"
@@ -0,0 +1,58 @@
+#!/bin/sh
+#
+# FGo - persistent mode speed comparison
+# --------------------------------------
+#
+# Builds fgo_persistent_demo.c with the FGo compiler wrapper in persistent
+# mode and in plain fork server mode, fuzzes each build for a while and
+# prints the average exec/s computed from fuzzer_stats.
+#
+# Usage: ./compare_exec_speed.sh /path/to/fgo-clang /path/to/afl-fuzz [seconds]
+#
+
+if [ "$#" -lt "2" ]; then
+  echo "Usage: $0 /path/to/fgo-clang /path/to/afl-fuzz [seconds]" 1>&2
+  exit 1
+fi
+
+FGO_CC="$1"
+AFL_FUZZ="$2"
+SECONDS_PER_RUN="${3:-30}"
+
+DEMO_DIR=`dirname "$0"`
+DEMO_DIR=`cd "$DEMO_DIR" && pwd`
+WORK_DIR=`mktemp -d "${TMPDIR:-/tmp}/fgo_persistent_demo.XXXXXX"` || exit 1
+
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+mkdir "$WORK_DIR/in"
+echo "hello" >"$WORK_DIR/in/seed"
+
+export FGO_PROJ_ROOT_DIR="$DEMO_DIR"
+export FGO_DIST_DIR="$DEMO_DIR"
+export AFL_QUIET=1 AFL_NO_UI=1 AFL_SKIP_CPUFREQ=1 AFL_I_DONT_CARE_ABOUT_MISSING_CRASHES=1
+
+for MODE in persistent forkserver; do
+
+  if [ "$MODE" = "persistent" ]; then
+    EXTRA_FLAGS=""
+  else
+    EXTRA_FLAGS="-DFGO_NO_PERSISTENT"
+  fi
+
+  "$FGO_CC" -g $EXTRA_FLAGS "$DEMO_DIR/fgo_persistent_demo.c" -o "$WORK_DIR/demo_$MODE" || exit 1
+
+  timeout -s INT "$SECONDS_PER_RUN" "$AFL_FUZZ" -i "$WORK_DIR/in" -o "$WORK_DIR/out_$MODE" \
+    -r "$DEMO_DIR" -- "$WORK_DIR/demo_$MODE" >/dev/null 2>&1
+
+  # execs_per_sec in fuzzer_stats is a smoothed value from the last screen
+  # update, so compute the average over the whole run instead.
+
+  STATS="$WORK_DIR/out_$MODE/fuzzer_stats"
+  EXECS=`awk '/^start_time/ {s = $3} /^last_update/ {l = $3} /^execs_done/ {e = $3}
+              END {if (l > s) printf "%.2f", e / (l - s)}' "$STATS" 2>/dev/null`
+  CRASHES=`grep '^unique_crashes' "$STATS" 2>/dev/null | awk '{print $3}'`
+
+  printf "%-12s exec/s: %-10s unique crashes: %s\n" "$MODE" "${EXECS:-n/a}" "${CRASHES:-n/a}"
+
+done
@@ -0,0 +1,67 @@
+/*
+  Licensed under the Apache License, Version 2.0 (the "License");
+  you may not use this file except in compliance with the License.
+  You may obtain a copy of the License at:
+
+    http://www.apache.org/licenses/LICENSE-2.0
+*/
+
+/*
+   FGo - persistent mode example
+   -----------------------------
+
+   The same shim as ../persistent_demo, built with the FGo compiler wrapper
+   and the distance files in this directory, where the abort() is the target.
+   Distance-instrumented targets work in persistent mode just like plain AFL
+   ones: the runtime discards the distances recorded before the loop, and
+   afl-fuzz resets the distance region before every iteration.
+
+   Build it in persistent mode (default) or in plain fork server mode with
+   -DFGO_NO_PERSISTENT to compare the execution speed; compare_exec_speed.sh
+   does both and prints the exec/s reported by afl-fuzz.
+*/
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef FGO_NO_PERSISTENT
+#define FGO_LOOP_COUNT 1
+#else
+#define FGO_LOOP_COUNT 1000
+#endif /* ^FGO_NO_PERSISTENT */
+
+/* Main entry point. */
+
+int main(int argc, char **argv) {
+
+  char buf[100];
+
+  /* In plain fork server mode, __AFL_LOOP(1) runs the body exactly once. */
+
+  while (__AFL_LOOP(FGO_LOOP_COUNT)) {
+
+    memset(buf, 0, 100);
+    read(0, buf, 100);
+
+    if (buf[0] == 'f') {
+      printf("one\n");
+      if (buf[1] == 'o') {
+        printf("two\n");
+        if (buf[2] == 'o') {
+          printf("three\n");
+          if (buf[3] == '!') {
+            printf("four\n");
+            abort();
+          }
+        }
+      }
+    }
+
+  }
+
+  return 0;
+
+}
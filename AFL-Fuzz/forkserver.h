@@ -0,0 +1,424 @@
+/*
+   FGo - fork server client
+   ------------------------
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   The parent side of the fork server protocol of the runtime, for the tools
+   that run a target many times: afl-tmin, afl-analyze, afl-showmap and the
+   sanitized replays of afl-fuzz. fsrv_start() execs the target once and
+   waits for its hello, then fsrv_run() asks for one child per test case
+   and returns its wait status. The SIGALRM handler of the tool is expected
+   to call fsrv_handle_timeout() first.
+
+   It also sets up the distance region FGo-instrumented binaries write past
+   the bitmap, and shows the per-target distances recorded there.
+
+*/
+
+#ifndef _HAVE_FORKSERVER_H
+#define _HAVE_FORKSERVER_H
+
+#include "config.h"
+#include "types.h"
+#include "debug.h"
+
+#if AFLGO_IMPL
+#include "../Utility/FGoDefs.h"
+#endif // AFLGO_IMPL
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+/* Signatures found by fsrv_check_binary(): */
+
+#define FSRV_BIN_INSTR      1   /* Reads the bitmap SHM ID          */
+#define FSRV_BIN_PERSIST    2   /* Persistent mode                  */
+#define FSRV_BIN_DEFER      4   /* Deferred fork server             */
+
+struct fsrv {
+
+  u8*    target_path;           /* Binary to run                    */
+  char** argv;                  /* Its command line                 */
+  u8*    trace_bits;            /* Its bitmap, for EXEC_FAIL_SIG    */
+  u64    mem_limit;             /* Memory limit (MB), 0 for none    */
+  s32    in_fd,                 /* stdin of the target, -1 to keep  */
+         out_fd;                /* stdout and stderr, -1 to keep    */
+  u8     keep_cores;            /* Allow coredumps?                 */
+  void (*child_setup)(void);    /* Run by the fork server at start  */
+
+  s32    pid,                   /* PID of the fork server           */
+         child_pid,             /* PID of the current child         */
+         ctl_fd,                /* Control pipe (write)             */
+         st_fd,                 /* Status pipe (read)               */
+         status;                /* Wait status of a failed start    */
+  u32    prev_timed_out;        /* Last child timed out?            */
+
+  volatile u8 running,          /* Waiting on the fork server?      */
+              timed_out;        /* Timed out while waiting?         */
+
+};
+
+
+/* Look for a NUL-terminated signature in a binary. */
+
+static inline u8 fsrv_find_sig(u8* data, u32 len, u8* sig) {
+
+  u32 sig_len = strlen(sig) + 1;
+  u8 *p = data, *end = data + len;
+
+  if (len < sig_len) return 0;
+
+  while ((p = memchr(p, sig[0], end - sig_len + 1 - p))) {
+
+    if (!memcmp(p, sig, sig_len)) return 1;
+    p++;
+
+  }
+
+  return 0;
+
+}
+
+
+/* Tell how a binary can be run, from the signatures afl-fuzz looks for as
+   well. Returns a combination of FSRV_BIN_*. */
+
+static inline u8 fsrv_check_binary(u8* path) {
+
+  struct stat st;
+  u8* data;
+  u8  ret = 0;
+  s32 fd = open(path, O_RDONLY);
+
+  if (fd < 0) return 0;
+
+  if (fstat(fd, &st) || !st.st_size) {
+    close(fd);
+    return 0;
+  }
+
+  data = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (data == MAP_FAILED) return 0;
+
+  if (fsrv_find_sig(data, st.st_size, SHM_ENV_VAR)) ret |= FSRV_BIN_INSTR;
+  if (fsrv_find_sig(data, st.st_size, PERSIST_SIG)) ret |= FSRV_BIN_PERSIST;
+  if (fsrv_find_sig(data, st.st_size, DEFER_SIG))   ret |= FSRV_BIN_DEFER;
+
+  munmap(data, st.st_size);
+
+  return ret;
+
+}
+
+
+/* Tell whether to run a binary through a fork server: it has to be
+   instrumented, and AFL_NO_FORKSRV unset. As in afl-fuzz, the persistent
+   and deferred modes are then enabled from the signatures. */
+
+static inline u8 fsrv_wanted(u8* path) {
+
+  u8 bin;
+
+  if (getenv("AFL_NO_FORKSRV")) return 0;
+
+  bin = fsrv_check_binary(path);
+
+  if (!(bin & FSRV_BIN_INSTR)) return 0;
+
+  if (bin & FSRV_BIN_PERSIST) setenv(PERSIST_ENV_VAR, "1", 1);
+  if (bin & FSRV_BIN_DEFER) setenv(DEFER_ENV_VAR, "1", 1);
+
+  return 1;
+
+}
+
+
+/* Arm or disarm the timer, 0 meaning none. */
+
+static inline void fsrv_set_timer(u32 tmout) {
+
+  struct itimerval it;
+
+  memset(&it, 0, sizeof(it));
+
+  it.it_value.tv_sec  = (tmout / 1000);
+  it.it_value.tv_usec = (tmout % 1000) * 1000;
+
+  setitimer(ITIMER_REAL, &it, NULL);
+
+}
+
+
+/* Start the fork server and wait up to tmout ms (0 for ever) for its
+   hello. Returns 1 when it is up. Otherwise, the fork server is gone, its
+   wait status is in fs->status and fs->timed_out tells if it hung; an
+   execv() failure leaves EXEC_FAIL_SIG in the bitmap. */
+
+static inline u8 fsrv_start(struct fsrv* fs, u32 tmout) {
+
+  int st_pipe[2], ctl_pipe[2];
+  s32 status, rlen;
+
+  if (pipe(st_pipe) || pipe(ctl_pipe)) PFATAL("pipe() failed");
+
+  fs->child_pid = 0;
+  fs->timed_out = 0;
+  fs->prev_timed_out = 0;
+
+  fs->pid = fork();
+
+  if (fs->pid < 0) PFATAL("fork() failed");
+
+  if (!fs->pid) {
+
+    struct rlimit r;
+
+    if (fs->mem_limit) {
+
+      r.rlim_max = r.rlim_cur = ((rlim_t)fs->mem_limit) << 20;
+
+#ifdef RLIMIT_AS
+
+      setrlimit(RLIMIT_AS, &r); /* Ignore errors */
+
+#else
+
+      setrlimit(RLIMIT_DATA, &r); /* Ignore errors */
+
+#endif /* ^RLIMIT_AS */
+
+    }
+
+    if (!fs->keep_cores) r.rlim_max = r.rlim_cur = 0;
+    else r.rlim_max = r.rlim_cur = RLIM_INFINITY;
+
+    setrlimit(RLIMIT_CORE, &r); /* Ignore errors */
+
+    setsid();
+
+    if ((fs->in_fd >= 0 && dup2(fs->in_fd, 0) < 0) ||
+        (fs->out_fd >= 0 && (dup2(fs->out_fd, 1) < 0 || dup2(fs->out_fd, 2) < 0)) ||
+        dup2(ctl_pipe[0], FORKSRV_FD) < 0 || dup2(st_pipe[1], FORKSRV_FD + 1) < 0) {
+
+      if (fs->trace_bits) *(u32*)fs->trace_bits = EXEC_FAIL_SIG;
+      PFATAL("dup2() failed");
+
+    }
+
+    if (fs->in_fd > 2) close(fs->in_fd);
+    if (fs->out_fd > 2 && fs->out_fd != fs->in_fd) close(fs->out_fd);
+
+    close(ctl_pipe[0]);
+    close(ctl_pipe[1]);
+    close(st_pipe[0]);
+    close(st_pipe[1]);
+
+    if (fs->child_setup) fs->child_setup();
+
+    if (!getenv("LD_BIND_LAZY")) setenv("LD_BIND_NOW", "1", 0);
+
+    setenv("ASAN_OPTIONS", "abort_on_error=1:"
+                           "detect_leaks=0:"
+                           "symbolize=0:"
+                           "allocator_may_return_null=1", 0);
+
+    setenv("MSAN_OPTIONS", "exit_code=" STRINGIFY(MSAN_ERROR) ":"
+                           "symbolize=0:"
+                           "abort_on_error=1:"
+                           "allocator_may_return_null=1:"
+                           "msan_track_origins=0", 0);
+
+    execv(fs->target_path, fs->argv);
+
+    if (fs->trace_bits) *(u32*)fs->trace_bits = EXEC_FAIL_SIG;
+    exit(0);
+
+  }
+
+  close(ctl_pipe[0]);
+  close(st_pipe[1]);
+
+  fs->ctl_fd = ctl_pipe[1];
+  fs->st_fd  = st_pipe[0];
+
+  fs->running = 1;
+  fsrv_set_timer(tmout);
+
+  rlen = read(fs->st_fd, &status, 4);
+
+  fsrv_set_timer(0);
+  fs->running = 0;
+
+  if (rlen == 4) {
+
+    /* Test cases come through files or stdin, whatever the runtime offers
+       instead. */
+
+    if (status & FS_OPT_ENABLED) {
+
+      u32 reply = 0;
+
+      if (write(fs->ctl_fd, &reply, 4) != 4)
+        RPFATAL(-1, "Unable to reply to the fork server");
+
+    }
+
+    return 1;
+
+  }
+
+  if (waitpid(fs->pid, &fs->status, 0) <= 0) PFATAL("waitpid() failed");
+
+  close(fs->ctl_fd);
+  close(fs->st_fd);
+  fs->pid = 0;
+
+  return 0;
+
+}
+
+
+/* Have the fork server run one child, waiting up to tmout ms (0 for ever)
+   for it. Returns 0 when the fork server can't be reached, e.g. after
+   fsrv_kill(); otherwise, the wait status of the child is in *status and
+   fs->timed_out tells if it was killed for the timeout. */
+
+static inline u8 fsrv_run(struct fsrv* fs, u32 tmout, int* status) {
+
+  fs->timed_out = 0;
+
+  if (write(fs->ctl_fd, &fs->prev_timed_out, 4) != 4 ||
+      read(fs->st_fd, &fs->child_pid, 4) != 4) return 0;
+
+  if (fs->child_pid <= 0) FATAL("Fork server is misbehaving (OOM?)");
+
+  fs->running = 1;
+  fsrv_set_timer(tmout);
+
+  if (read(fs->st_fd, status, 4) != 4) {
+    fsrv_set_timer(0);
+    fs->running = 0;
+    return 0;
+  }
+
+  fsrv_set_timer(0);
+  fs->running = 0;
+
+  /* A persistent child stops instead of exiting, and is resumed by the
+     fork server for the next run. */
+
+  if (!WIFSTOPPED(*status)) fs->child_pid = 0;
+
+  fs->prev_timed_out = fs->timed_out;
+
+  return 1;
+
+}
+
+
+/* For the SIGALRM handler: kill the child, or the fork server while it is
+   starting up. Returns 0 if the timer wasn't set by this client. */
+
+static inline u8 fsrv_handle_timeout(struct fsrv* fs) {
+
+  if (!fs->running) return 0;
+
+  fs->timed_out = 1;
+
+  if (fs->child_pid > 0) kill(fs->child_pid, SIGKILL);
+  else if (fs->pid > 0) kill(fs->pid, SIGKILL);
+
+  return 1;
+
+}
+
+
+/* Kill the child and the fork server, e.g. from a stop signal handler. */
+
+static inline void fsrv_kill(struct fsrv* fs) {
+
+  if (fs->child_pid > 0) kill(fs->child_pid, SIGKILL);
+  if (fs->pid > 0) kill(fs->pid, SIGKILL);
+
+}
+
+
+#if AFLGO_IMPL
+
+/* Size of the SHM of FGo-instrumented binaries, with the distance region of
+   FGO_TARGET_MAX_COUNT slots past the bitmap. */
+
+#define FGO_AREA_SIZE (MAP_SIZE + FGO_TARGET_MAX_COUNT * FGO_DIST_SLOT_SIZE)
+
+/* Clear the distance region before a run, seeding the minimal distances
+   with INT32_MAX as afl-fuzz does. */
+
+static inline void dist_region_reset(u8* region) {
+
+  u32 i;
+
+  memset(region, 0, FGO_TARGET_MAX_COUNT * FGO_DIST_SLOT_SIZE);
+
+  for (i = 0; i < FGO_TARGET_MAX_COUNT; i++)
+    *(u64*)(region + i * FGO_DIST_SLOT_SIZE + FGO_DIST_SLOT_MIN_OFFSET) =
+      INT32_MAX;
+
+}
+
+/* Show the distances of the last run to the targets it got near. The
+   transitional distance is 0 when a target was reached. Returns the number
+   of such targets. */
+
+static inline u32 dist_region_show(u8* region) {
+
+  u32 i, ret = 0;
+
+  for (i = 0; i < FGO_TARGET_MAX_COUNT; i++) {
+
+    u64* slot = (u64*)(region + i * FGO_DIST_SLOT_SIZE);
+    u64  df_cnt  = slot[FGO_DIST_SLOT_DF_CNT_OFFSET / 8],
+         df_dist = slot[FGO_DIST_SLOT_DF_DIST_OFFSET / 8],
+         bt_cnt  = slot[FGO_DIST_SLOT_BT_CNT_OFFSET / 8],
+         bt_dist = slot[FGO_DIST_SLOT_BT_DIST_OFFSET / 8],
+         min     = slot[FGO_DIST_SLOT_MIN_OFFSET / 8];
+    u8 df[32] = "-", bt[32] = "-";
+
+    if (!df_cnt && !bt_cnt && min == INT32_MAX) continue;
+
+    if (df_cnt) sprintf(df, "%.02f", (double)df_dist / df_cnt);
+    if (bt_cnt) sprintf(bt, "%.02f", (double)bt_dist / bt_cnt);
+
+    OKF("Target %02u: transitional %llu, depth-first %s, backtrace %s%s", i,
+        min, df, bt, min ? "" : cLGN " (reached)" cRST);
+
+    ret++;
+
+  }
+
+  if (!ret) WARNF("No distance to any target was recorded.");
+
+  return ret;
+
+}
+
+#endif // AFLGO_IMPL
+
+#endif /* ! _HAVE_FORKSERVER_H */
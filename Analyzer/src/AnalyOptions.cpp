@@ -230,6 +230,8 @@ void Options::parseArguments(int argc, char **argv)
     m_bbBTDistFile = joinPath(m_outDirectory, BT_BB_DIST_NAME);
     m_targetFuzzingInfoFile = joinPath(m_outDirectory, TARGET_INFO_NAME);
     m_bbFinalDistFile = joinPath(m_outDirectory, FINAL_BB_DIST_NAME);
+    m_bbDistShardDir = joinPath(m_outDirectory, BB_DIST_SHARD_NAME);
+    m_deferPointFile = joinPath(m_outDirectory, DEFER_POINT_NAME);
 
     // Check project root directory
     if (m_projRootDir.empty()) {
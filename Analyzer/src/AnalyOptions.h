@@ -28,7 +28,9 @@ private:
     const String DF_BB_DIST_NAME = DF_DISTANCE_FILENAME;
     const String BT_BB_DIST_NAME = BT_DISTANCE_FILENAME;
     const String FINAL_BB_DIST_NAME = FINAL_DISTANCE_FILENAME;
+    const String BB_DIST_SHARD_NAME = DIST_SHARD_DIRNAME;
     const String TARGET_INFO_NAME = TARGET_INFO_FILENAME;
+    const String DEFER_POINT_NAME = DEFER_POINT_FILENAME;
     const String EXT_API_FILENAME = "extapi.bc";
 
     const String PROJ_ROOT_DIR_ENV = PROJ_ROOT_ENVAR;
@@ -53,8 +55,10 @@ public:
     String m_bbDFDistFile;        // File containing depth-first distances for basic blocks
     String m_bbBTDistFile;        // File conatining backtrace distances for basic blocks
     String m_bbFinalDistFile;     // File containing final distances for basic blocks
+    String m_bbDistShardDir;      // Directory containing per-file distance shards
 
     String m_targetFuzzingInfoFile; // File containing target information for fuzzing
+    String m_deferPointFile;        // File containing the point for the deferred fork server
 
     String m_projRootDir; // Root directory of the relevant project
 
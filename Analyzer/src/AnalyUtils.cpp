@@ -199,6 +199,23 @@ void replaceString(String &str, const String &origin, const String &replacement)
     }
 }
 
+uint64_t getFNVHash(const String &input)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (unsigned char c : input) {
+        hash ^= c;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+String getHashString(uint64_t hash)
+{
+    std::stringstream ss;
+    ss << std::hex << std::setw(16) << std::setfill('0') << hash;
+    return ss.str();
+}
+
 String getNodeIDString(uint32_t nodeID)
 {
     std::stringstream ss;
@@ -327,6 +344,12 @@ String joinPath(const String &basePath, const String &fileName)
     return llvmBasePath.str().str();
 }
 
+bool createDirectory(const String &path)
+{
+    if (llvm::sys::fs::create_directories(path)) return false;
+    return llvm::sys::fs::is_directory(path);
+}
+
 int64_t getFileSize(const String &filePath)
 {
     uint64_t fileSize = 0;
@@ -189,6 +189,16 @@ String trimString(const String &input, const String &space = "");
 
 void replaceString(String &str, const String &origin, const String &replacement);
 
+/// @brief Calculate the 64-bit FNV-1a hash of a string
+/// @param input
+/// @return
+uint64_t getFNVHash(const String &input);
+
+/// @brief Convert a 64-bit hash to a fixed-width hex string
+/// @param hash
+/// @return
+String getHashString(uint64_t hash);
+
 /// @brief Convert a node ID to a string
 /// @param nodeID Node ID in SVF
 /// @return A node ID string
@@ -258,6 +268,11 @@ bool pathIsFile(const String &path);
 /// @return
 bool pathIsDirectory(const String &path);
 
+/// @brief Create a directory and its missing parents.
+/// @param path
+/// @return true if the directory exists after the call
+bool createDirectory(const String &path);
+
 /// @brief Get file size
 /// @param filePath
 /// @return the file size, otherwise -1
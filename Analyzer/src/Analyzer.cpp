@@ -19,6 +19,7 @@
 #include "json/json.h"
 #include <algorithm>
 #include <fstream>
+#include <functional>
 #include <iomanip>
 #include <sstream>
 
@@ -440,8 +441,19 @@ GraphAnalyzer::TargetLocation::TargetLocation(const String &targetLoc)
 
     auto lineStr = targetLoc.substr(pos + 1);
     lineStr = trimString(lineStr);
-    if (!lineStr.empty()) line = std::stoul(lineStr);
-    else throw AnalyException("Invalid target location " + targetLoc);
+    if (lineStr.empty()) throw AnalyException("Invalid target location " + targetLoc);
+
+    // An optional weight may follow the line number, e.g. "main.c:233 2.5"
+    size_t lineEnd = 0;
+    line = std::stoul(lineStr, &lineEnd);
+    weight = 1.0;
+    auto weightStr = trimString(lineStr.substr(lineEnd));
+    if (!weightStr.empty()) {
+        size_t weightEnd = 0;
+        weight = std::stod(weightStr, &weightEnd);
+        if (weightEnd != weightStr.size() || !(weight > 0))
+            throw AnalyException("Invalid target weight in " + targetLoc);
+    }
 }
 
 bool GraphAnalyzer::TargetLocation::isTarget(unsigned _line, const String &_filePath)
@@ -516,9 +528,18 @@ void GraphAnalyzer::loadTargets(const String &targetFile)
                     throw AnalyException("Invalid format of target file " + targetFile);
                 if (!root[i].isMember("file"))
                     throw AnalyException("Invalid format of target file " + targetFile);
-                m_targetLocations.push_back(
-                    TargetLocation(root[i]["line"].asUInt(), root[i]["file"].asString())
-                );
+                double weight = 1.0;
+                if (root[i].isMember("weight")) {
+                    if (!root[i]["weight"].isNumeric() || !(root[i]["weight"].asDouble() > 0))
+                        throw AnalyException(
+                            "Invalid weight of Target " + toString(i) + " in target file " +
+                            targetFile
+                        );
+                    weight = root[i]["weight"].asDouble();
+                }
+                m_targetLocations.push_back(TargetLocation(
+                    root[i]["line"].asUInt(), root[i]["file"].asString(), weight
+                ));
             }
         }
         else {
@@ -1340,22 +1361,11 @@ void GraphAnalyzer::dumpBlocksDistance(
     m_progressBar.stop();
 }
 
-void GraphAnalyzer::dumpBasicBlockDistance(
-    const String &outBBDistFile, bool isPseudo /*=false*/
-)
+void GraphAnalyzer::getBasicBlockDistanceJson(Json::Value &root, bool isPseudo)
 {
-    String filePath = outBBDistFile + ".json";
-
     Map<SVF::NodeID, Vector<int32_t>> tmpBlockDistMap;
-    if (!isPseudo) {
-        m_progressBar.start(0, "Writing depth-first distances for basic blocks", true);
-        tmpBlockDistMap = m_blockDistMap;
-    }
-    else {
-        m_progressBar.start(0, "Writing backtrace distances for basic blocks", true);
-        tmpBlockDistMap = m_blockPseudoDistMap;
-    }
-    m_progressBar.show("Dumping to " + filePath);
+    if (!isPseudo) tmpBlockDistMap = m_blockDistMap;
+    else tmpBlockDistMap = m_blockPseudoDistMap;
 
     Map<const SVF::SVFBasicBlock *, Vector<int32_t>> BBDistMap;
     for (auto &key_value : tmpBlockDistMap) {
@@ -1370,7 +1380,7 @@ void GraphAnalyzer::dumpBasicBlockDistance(
         }
     }
 
-    Json::Value root;
+    root = Json::Value(Json::objectValue);
     for (auto &key_value : BBDistMap) {
         unsigned line = 0, column = 0;
         String file("");
@@ -1392,6 +1402,358 @@ void GraphAnalyzer::dumpBasicBlockDistance(
             }
         }
     }
+}
+
+void GraphAnalyzer::dumpBasicBlockDistance(
+    const String &outBBDistFile, bool isPseudo /*=false*/
+)
+{
+    String filePath = outBBDistFile + ".json";
+
+    if (!isPseudo)
+        m_progressBar.start(0, "Writing depth-first distances for basic blocks", true);
+    else m_progressBar.start(0, "Writing backtrace distances for basic blocks", true);
+    m_progressBar.show("Dumping to " + filePath);
+
+    Json::Value root;
+    getBasicBlockDistanceJson(root, isPseudo);
+
+    std::ofstream ofs(filePath, std::ios::out | std::ios::trunc);
+    if (!ofs.is_open()) throw AnalyException("Failed to open output file " + filePath);
+    Json::StreamWriterBuilder builder;
+    const std::unique_ptr<Json::StreamWriter> writer(builder.newStreamWriter());
+    writer->write(root, &ofs);
+
+    m_progressBar.stop();
+}
+
+void GraphAnalyzer::dumpBasicBlockDistanceShards(const String &outShardDir)
+{
+    m_progressBar.start(0, "Writing per-file distance shards for basic blocks", true);
+    m_progressBar.show("Dumping to " + outShardDir);
+
+    if (!createDirectory(outShardDir))
+        throw AnalyException("Failed to create the shard directory " + outShardDir);
+
+    Json::Value dfRoot, btRoot;
+    getBasicBlockDistanceJson(dfRoot, false);
+    getBasicBlockDistanceJson(btRoot, true);
+
+    Set<String> srcFiles;
+    for (const auto &file : dfRoot.getMemberNames()) srcFiles.emplace(file);
+    for (const auto &file : btRoot.getMemberNames()) srcFiles.emplace(file);
+
+    // One shard per source file. Each shard is written in a canonical
+    // (non-indented, key-sorted) form so that its hash only changes when the
+    // distances of this file change.
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    std::stringstream indexStream;
+    indexStream << "TargetCount\t" << m_targetCount << "\n";
+    for (const auto &file : srcFiles) {
+        Json::Value shardRoot;
+        shardRoot["TargetCount"] = (Json::UInt)m_targetCount;
+        shardRoot["DF"] = dfRoot.isMember(file) ? dfRoot[file] : Json::Value(Json::objectValue);
+        shardRoot["BT"] = btRoot.isMember(file) ? btRoot[file] : Json::Value(Json::objectValue);
+        String shardContent = Json::writeString(builder, shardRoot);
+
+        String shardName = getHashString(getFNVHash(file)) + ".json";
+        String shardPath = joinPath(outShardDir, shardName);
+        std::ofstream ofs(shardPath, std::ios::out | std::ios::trunc);
+        if (!ofs.is_open()) throw AnalyException("Failed to open output file " + shardPath);
+        ofs << shardContent;
+        ofs.close();
+
+        indexStream << getHashString(getFNVHash(shardContent)) << "\t" << shardName << "\t"
+                    << file << "\n";
+    }
+
+    String indexPath = joinPath(outShardDir, DIST_SHARD_INDEX_FILENAME);
+    std::ofstream ofs(indexPath, std::ios::out | std::ios::trunc);
+    if (!ofs.is_open()) throw AnalyException("Failed to open output file " + indexPath);
+    ofs << indexStream.str();
+    ofs.close();
+
+    m_progressBar.stop();
+}
+
+Set<String> GraphAnalyzer::getCalleeNames(const SVF::CallICFGNode *callNode)
+{
+    Set<String> calleeNames;
+    for (auto iter = callNode->OutEdgeBegin(); iter != callNode->OutEdgeEnd(); ++iter) {
+        auto dstNode = (*iter)->getDstNode();
+        if (dstNode->getNodeKind() == SVF::ICFGNode::ICFGNodeK::FunEntryBlock)
+            calleeNames.emplace(dstNode->getFun()->getName());
+    }
+    if (calleeNames.empty()) {
+        auto callee = SVF::SVFUtil::getCallee(callNode->getCallSite());
+        if (callee) calleeNames.emplace(callee->getName());
+    }
+    return calleeNames;
+}
+
+const SVF::ICFGNode *
+GraphAnalyzer::findDeferredInitPoint(const SVF::FunEntryICFGNode *mainEntryNode)
+{
+    // APIs through which programs usually get their input
+    static const Set<String> inputAPIs = {
+        "read",    "pread",         "pread64",         "readv",    "fread",   "fread_unlocked",
+        "fgets",   "fgets_unlocked", "fgetc",           "getc",     "_IO_getc", "getc_unlocked",
+        "getchar", "getline",       "getdelim",        "gets",     "scanf",   "fscanf",
+        "vfscanf", "__isoc99_scanf", "__isoc99_fscanf", "recv",     "recvfrom", "recvmsg",
+        "mmap",    "mmap64",        "open",            "open64",   "openat",  "fopen",
+        "fopen64", "freopen",       "fdopen"};
+
+    // APIs starting threads, child processes, timers or signal handlers, which
+    // the fork server must not come after
+    static const Set<String> barrierAPIs = {
+        "pthread_create", "thrd_create", "fork",        "vfork",        "clone",
+        "daemon",         "system",      "popen",       "posix_spawn",  "posix_spawnp",
+        "execl",          "execlp",      "execle",      "execv",        "execvp",
+        "execve",         "signal",      "sigaction",   "sigset",       "alarm",
+        "ualarm",         "setitimer",   "timer_create", "timer_settime"};
+
+    auto isAnyOf = [](const Set<String> &names, const Set<String> &funcs) {
+        return std::any_of(names.begin(), names.end(), [&funcs](const String &name) {
+            return funcs.find(name) != funcs.end();
+        });
+    };
+
+    // Functions with a call matching `isMatchingCall` directly or via their
+    // callees
+    auto collectFuncs = [this](const std::function<bool(const SVF::CallICFGNode *)> &isMatchingCall) {
+        Set<String> matchingFuncs;
+        for (const auto &key_value : m_simpleCallGraph) {
+            auto funcExitNode = m_icfg->getFunExitICFGNode(key_value.first->getFun());
+            Queue<const SVF::ICFGNode *> workNodeQueue;
+            Set<const SVF::ICFGNode *> visitedNodes;
+            workNodeQueue.push(key_value.first);
+            auto funcName = key_value.first->getFun()->getName();
+            while (!workNodeQueue.empty() && matchingFuncs.find(funcName) == matchingFuncs.end()) {
+                auto bfsCurrentNode = workNodeQueue.front();
+                workNodeQueue.pop();
+                if (bfsCurrentNode == funcExitNode) continue;
+                if (visitedNodes.find(bfsCurrentNode) != visitedNodes.end()) continue;
+                else visitedNodes.emplace(bfsCurrentNode);
+
+                if (auto callNode = SVF::SVFUtil::dyn_cast<SVF::CallICFGNode>(bfsCurrentNode)) {
+                    if (isMatchingCall(callNode)) matchingFuncs.emplace(funcName);
+                    workNodeQueue.push(callNode->getRetICFGNode());
+                    continue;
+                }
+                for (auto iter = bfsCurrentNode->OutEdgeBegin();
+                     iter != bfsCurrentNode->OutEdgeEnd(); ++iter)
+                    workNodeQueue.push((*iter)->getDstNode());
+            }
+        }
+        bool isChanged = true;
+        while (isChanged) {
+            isChanged = false;
+            for (const auto &key_value : m_simpleCallGraph) {
+                auto funcName = key_value.first->getFun()->getName();
+                if (matchingFuncs.find(funcName) != matchingFuncs.end()) continue;
+                for (const auto &callee : key_value.second) {
+                    if (matchingFuncs.find(callee->getFun()->getName()) != matchingFuncs.end()) {
+                        matchingFuncs.emplace(funcName);
+                        isChanged = true;
+                        break;
+                    }
+                }
+            }
+        }
+        return matchingFuncs;
+    };
+
+    // Functions reading input, and functions starting one of the above or
+    // making an indirect call that could not be resolved, directly or via
+    // their callees
+    Set<String> readingFuncs = collectFuncs([&](const SVF::CallICFGNode *callNode) {
+        return isAnyOf(getCalleeNames(callNode), inputAPIs);
+    });
+    Set<String> barrierFuncs = collectFuncs([&](const SVF::CallICFGNode *callNode) {
+        auto calleeNames = getCalleeNames(callNode);
+        return calleeNames.empty() || isAnyOf(calleeNames, barrierAPIs);
+    });
+
+    // Collect the intra-procedural graph of `main` in reverse post-order. A call
+    // node is followed by its return node.
+    auto mainFunc = mainEntryNode->getFun();
+    auto getSuccessors = [mainFunc](const SVF::ICFGNode *node) {
+        Vector<const SVF::ICFGNode *> successors;
+        if (auto callNode = SVF::SVFUtil::dyn_cast<SVF::CallICFGNode>(node)) {
+            successors.push_back(callNode->getRetICFGNode());
+            return successors;
+        }
+        if (node->getNodeKind() == SVF::ICFGNode::ICFGNodeK::FunExitBlock) return successors;
+        for (auto iter = node->OutEdgeBegin(); iter != node->OutEdgeEnd(); ++iter) {
+            if ((*iter)->getDstNode()->getFun() == mainFunc)
+                successors.push_back((*iter)->getDstNode());
+        }
+        return successors;
+    };
+
+    Vector<const SVF::ICFGNode *> orderedNodes;
+    Map<const SVF::ICFGNode *, size_t> nodeOrders;
+    Map<const SVF::ICFGNode *, Vector<const SVF::ICFGNode *>> predecessors;
+    {
+        Vector<Pair<const SVF::ICFGNode *, size_t>> dfsStack;
+        Set<const SVF::ICFGNode *> visitedNodes;
+        Map<const SVF::ICFGNode *, Vector<const SVF::ICFGNode *>> successorMap;
+        dfsStack.emplace_back(mainEntryNode, 0);
+        visitedNodes.emplace(mainEntryNode);
+        successorMap[mainEntryNode] = getSuccessors(mainEntryNode);
+        while (!dfsStack.empty()) {
+            auto &top = dfsStack.back();
+            auto &successors = successorMap[top.first];
+            if (top.second < successors.size()) {
+                auto succNode = successors[top.second++];
+                predecessors[succNode].push_back(top.first);
+                if (visitedNodes.find(succNode) == visitedNodes.end()) {
+                    visitedNodes.emplace(succNode);
+                    successorMap[succNode] = getSuccessors(succNode);
+                    dfsStack.emplace_back(succNode, 0);
+                }
+            }
+            else {
+                orderedNodes.push_back(top.first);
+                dfsStack.pop_back();
+            }
+        }
+        std::reverse(orderedNodes.begin(), orderedNodes.end());
+        for (size_t i = 0; i < orderedNodes.size(); ++i) nodeOrders[orderedNodes[i]] = i;
+    }
+
+    // Immediate dominators (Cooper, Harvey and Kennedy)
+    Vector<size_t> idoms(orderedNodes.size(), SIZE_MAX);
+    auto intersect = [&idoms](size_t a, size_t b) {
+        while (a != b) {
+            while (a > b) a = idoms[a];
+            while (b > a) b = idoms[b];
+        }
+        return a;
+    };
+    idoms[0] = 0;
+    bool isChanged = true;
+    while (isChanged) {
+        isChanged = false;
+        for (size_t i = 1; i < orderedNodes.size(); ++i) {
+            size_t newIdom = SIZE_MAX;
+            for (auto predNode : predecessors[orderedNodes[i]]) {
+                size_t predOrder = nodeOrders[predNode];
+                if (idoms[predOrder] == SIZE_MAX) continue;
+                newIdom = newIdom == SIZE_MAX ? predOrder : intersect(predOrder, newIdom);
+            }
+            if (newIdom != idoms[i]) {
+                idoms[i] = newIdom;
+                isChanged = true;
+            }
+        }
+    }
+
+    // Input reads in `main`, preferring the ones leading to targets, and the
+    // barriers in `main`
+    Set<size_t> readOrders, targetReadOrders, barrierOrders;
+    for (size_t i = 0; i < orderedNodes.size(); ++i) {
+        auto callNode = SVF::SVFUtil::dyn_cast<SVF::CallICFGNode>(orderedNodes[i]);
+        if (!callNode) continue;
+        auto calleeNames = getCalleeNames(callNode);
+        if (calleeNames.empty() || isAnyOf(calleeNames, barrierAPIs) ||
+            isAnyOf(calleeNames, barrierFuncs))
+            barrierOrders.emplace(i);
+        if (!isAnyOf(calleeNames, inputAPIs) && !isAnyOf(calleeNames, readingFuncs)) continue;
+        readOrders.emplace(i);
+        auto distIter = m_blockDistMap.find(callNode->getId());
+        if (distIter != m_blockDistMap.end() &&
+            std::any_of(distIter->second.begin(), distIter->second.end(), [](int32_t dist) {
+                return dist >= 0;
+            }))
+            targetReadOrders.emplace(i);
+    }
+    if (readOrders.empty()) return nullptr;
+    if (targetReadOrders.empty()) targetReadOrders = readOrders;
+
+    size_t pointOrder = *targetReadOrders.begin();
+    for (auto order : targetReadOrders) pointOrder = intersect(pointOrder, order);
+
+    // Move up the dominator tree while some input read or barrier can still
+    // happen before the point, or while the point has no source location
+    while (pointOrder != 0) {
+        Set<size_t> beforeOrders;
+        Queue<size_t> workQueue;
+        workQueue.push(0);
+        while (!workQueue.empty()) {
+            auto curOrder = workQueue.front();
+            workQueue.pop();
+            if (curOrder == pointOrder || beforeOrders.find(curOrder) != beforeOrders.end())
+                continue;
+            beforeOrders.emplace(curOrder);
+            for (auto succNode : getSuccessors(orderedNodes[curOrder]))
+                workQueue.push(nodeOrders[succNode]);
+        }
+
+        bool isUnsafeBefore = false;
+        for (const auto *orders : {&readOrders, &barrierOrders}) {
+            for (auto order : *orders) {
+                if (order != pointOrder && beforeOrders.find(order) != beforeOrders.end()) {
+                    isUnsafeBefore = true;
+                    break;
+                }
+            }
+            if (isUnsafeBefore) break;
+        }
+
+        auto locIter = m_nodeLocations.find(orderedNodes[pointOrder]->getId());
+        if (!isUnsafeBefore && locIter != m_nodeLocations.end() && locIter->second.line > 0 &&
+            !locIter->second.file.empty())
+            break;
+        pointOrder = idoms[pointOrder];
+    }
+
+    return orderedNodes[pointOrder];
+}
+
+void GraphAnalyzer::dumpDeferredInitPoint(const String &outDeferPointFile)
+{
+    String filePath = outDeferPointFile + ".json";
+
+    m_progressBar.start(0, "Writing the point for the deferred fork server", true);
+    m_progressBar.show("Dumping to " + filePath);
+
+    const SVF::FunEntryICFGNode *mainEntryNode = nullptr;
+    for (const auto &key_value : m_simpleCallGraph) {
+        if (key_value.first->getFun()->getName() == "main") {
+            mainEntryNode = key_value.first;
+            break;
+        }
+    }
+
+    const SVF::ICFGNode *pointNode = nullptr;
+    if (mainEntryNode) pointNode = findDeferredInitPoint(mainEntryNode);
+
+    Json::Value root;
+    root["Found"] = false;
+    if (pointNode && m_nodeLocations.find(pointNode->getId()) != m_nodeLocations.end()) {
+        const auto &pointLocation = m_nodeLocations[pointNode->getId()];
+        String file = getRelSrcFilePath(pointLocation.file, pointLocation.filePathChunks);
+
+        // The block of the point, as its index among the blocks of `main`,
+        // since a line can span several blocks
+        const auto &mainBlocks = pointNode->getFun()->getBasicBlockList();
+        auto blockIter = std::find(mainBlocks.begin(), mainBlocks.end(), pointNode->getBB());
+
+        if (!file.empty() && pointLocation.line > 0 && blockIter != mainBlocks.end()) {
+            root["Found"] = true;
+            root["Function"] = "main";
+            root["File"] = file;
+            root["Line"] = pointLocation.line;
+            root["IsCall"] = SVF::SVFUtil::isa<SVF::CallICFGNode>(pointNode);
+            root["Block"] = (Json::UInt)(blockIter - mainBlocks.begin());
+            root["BlockCount"] = (Json::UInt)mainBlocks.size();
+            m_progressBar.show(
+                "Deferred fork server at " + file + ":" + toString(pointLocation.line)
+            );
+        }
+    }
 
     std::ofstream ofs(filePath, std::ios::out | std::ios::trunc);
     if (!ofs.is_open()) throw AnalyException("Failed to open output file " + filePath);
@@ -1488,6 +1850,7 @@ void GraphAnalyzer::dumpTargetFuzzingInfo(const String &outFuzzingInfoFile, bool
             tmpJsonRoot["Method"] = "Frequency";
         }
         tmpJsonRoot["Start"] = probStart;
+        tmpJsonRoot["Weight"] = m_targetLocations[i].weight;
         tmpJsonRoot["Quantile"] = Json::Value();
         tmpJsonRoot["Quantile"].resize(probQuantile.size());
         for (Json::Value::ArrayIndex j = 0; j < probQuantile.size(); ++j) {
@@ -280,6 +280,24 @@ private:
 
     void subCalculateFinalBlocks(const SVF::FunEntryICFGNode *funcEntryNode);
 
+    /// @brief Collect the distances for basic blocks as `file -> line -> distances`
+    /// @param root
+    /// @param isPseudo
+    void getBasicBlockDistanceJson(Json::Value &root, bool isPseudo);
+
+    /// @brief Get the names of the functions possibly called at a call node,
+    /// including external functions
+    /// @param callNode
+    /// @return an empty set if the callee is unknown
+    Set<String> getCalleeNames(const SVF::CallICFGNode *callNode);
+
+    /// @brief Find the latest node in `main` that dominates all the input reads
+    /// leading to targets, with no input read, thread, child process, timer,
+    /// signal handler or unresolved indirect call on the way to it
+    /// @param mainEntryNode
+    /// @return nullptr if there is no such node
+    const SVF::ICFGNode *findDeferredInitPoint(const SVF::FunEntryICFGNode *mainEntryNode);
+
     /// @brief Get the relative path of source file name from SVF module
     /// @param fileName
     /// @param fileNameChunks
@@ -370,6 +388,21 @@ public:
     /// @exception `std::exception`
     void dumpBasicBlockDistance(const String &outBBDistFile, bool isPseudo = false);
 
+    /// @brief Dump the distances for basic blocks as per-source-file shards along
+    /// with an index of their content hashes, so that the compiler wrapper can
+    /// reuse objects whose distances didn't change.
+    /// @param outShardDir
+    /// @exception `AnalyException`
+    /// @exception `std::exception`
+    void dumpBasicBlockDistanceShards(const String &outShardDir);
+
+    /// @brief Dump the point in `main` where the deferred fork server can be
+    /// started, i.e., right before the first input read leading to targets
+    /// @param outDeferPointFile
+    /// @exception `AnalyException`
+    /// @exception `std::exception`
+    void dumpDeferredInitPoint(const String &outDeferPointFile);
+
     /// @brief Dump some information for fuzzing
     /// @param outFuzzingInfoFile
     /// @exception `UnexpectedException`
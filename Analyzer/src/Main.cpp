@@ -77,6 +77,8 @@ int main(int argc, char **argv)
         if (options.m_isDumpBBDist) {
             graphAnaly.dumpBasicBlockDistance(options.m_bbDFDistFile, false);
             graphAnaly.dumpBasicBlockDistance(options.m_bbBTDistFile, true);
+            graphAnaly.dumpBasicBlockDistanceShards(options.m_bbDistShardDir);
+            graphAnaly.dumpDeferredInitPoint(options.m_deferPointFile);
         }
 
         graphAnaly.dumpTargetFuzzingInfo(
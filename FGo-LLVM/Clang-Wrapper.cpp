@@ -26,10 +26,15 @@
 #include <cstdlib>
 #include <cstring>
 #include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <limits>
+#include <set>
+#include <sstream>
 #include <string>
+#include <sys/wait.h>
 #include <unistd.h>
+#include <unordered_map>
 #include <vector>
 
 #ifndef LLVM_PASS_LIB_NAME
@@ -38,6 +43,9 @@
 #ifndef LLVM_RUNTIME_OBJ_NAME
     #define LLVM_RUNTIME_OBJ_NAME "llvm-runtime"
 #endif
+#ifndef LIBFUZZER_DRIVER_OBJ_NAME
+    #define LIBFUZZER_DRIVER_OBJ_NAME "libfuzzer-driver"
+#endif
 #ifndef COMPILER_CLANG_PATH
     #define COMPILER_CLANG_PATH "clang"
 #endif
@@ -64,6 +72,7 @@ private:
     std::string m_LLVMRuntimeObj;
     std::string m_LLVMRuntime32Obj;
     std::string m_LLVMRuntime64Obj;
+    std::string m_LibFuzzerDriverObj;
 
 public:
     CompilerWrapper(int argc, char **argv);
@@ -72,7 +81,24 @@ public:
     /// @brief Update the arguments
     void updateArguments();
 
+    /// @brief Serve a compile-only invocation from the object cache under
+    /// `OBJ_CACHE_DIR_ENVAR`. The cache key consists of the preprocessed
+    /// source, the compiler flags and the distance shards of all the files
+    /// included by the translation unit.
+    /// @return the exit status of the compilation, or -1 if the invocation
+    /// is not cacheable
+    int executeWithCache();
+
     void execute();
+
+private:
+    /// @brief Get the name of the underlying compiler
+    std::string getCompilerName();
+
+    /// @brief Run the underlying compiler and wait for it
+    /// @param arguments
+    /// @return the exit status of the compiler
+    int runCompiler(const std::vector<std::string> &arguments);
 };
 
 static std::string joinPath(const std::string &basePath, const std::string &fileName)
@@ -107,6 +133,56 @@ static bool pathIsFile(const std::string &filePath)
     return std::filesystem::is_regular_file(fsFilePath);
 }
 
+static bool isSourceFile(const std::string &filePath)
+{
+    static const std::set<std::string> srcExtensions = {".c",  ".cc", ".cpp", ".cxx",
+                                                        ".c++", ".C",  ".i",   ".ii"};
+    std::filesystem::path fsFilePath = filePath;
+    return srcExtensions.find(fsFilePath.extension().string()) != srcExtensions.end();
+}
+
+static uint64_t getFNVHash(const std::string &input, uint64_t hash = 0xcbf29ce484222325ULL)
+{
+    for (unsigned char c : input) {
+        hash ^= c;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static std::string getHashString(uint64_t hash)
+{
+    char buffer[17];
+    snprintf(buffer, sizeof(buffer), "%016llx", (unsigned long long)hash);
+    return std::string(buffer);
+}
+
+static bool readFileContent(const std::string &filePath, std::string &content)
+{
+    std::ifstream ifs(filePath, std::ios::in | std::ios::binary);
+    if (!ifs.is_open()) return false;
+    std::stringstream ss;
+    ss << ifs.rdbuf();
+    content = ss.str();
+    return true;
+}
+
+static bool copyFile(const std::string &fromPath, const std::string &toPath)
+{
+    std::error_code ec;
+    std::filesystem::copy_file(
+        fromPath, toPath, std::filesystem::copy_options::overwrite_existing, ec
+    );
+    return !ec;
+}
+
+static bool createDirectoryIfMissing(const std::string &dirPath)
+{
+    std::error_code ec;
+    std::filesystem::create_directories(dirPath, ec);
+    return pathIsDirectory(dirPath);
+}
+
 static std::string getExeDirPath()
 {
     char buffer[PATH_MAX];
@@ -133,6 +209,13 @@ CompilerWrapper::CompilerWrapper(int argc, char **argv)
                   << "'AFL_DONT_OPTIMIZE'\n"
                   << "'AFL_NO_BUILTIN'\n"
                   << "'AFL_QUIET'\n"
+                  << "\n'-fsanitize=fuzzer' links libFuzzer-style harnesses with the FGo "
+                     "driver.\n"
+                  << "\nFGo specific environment variables:\n"
+                  << "'" OBJ_CACHE_DIR_ENVAR "' to reuse objects whose distance shards are "
+                     "unchanged\n"
+                  << "'" ASAN_MAX_DIST_ENVAR "' to keep ASan only in the functions within "
+                     "this distance of a target\n"
                   << std::endl;
         exit(1);
     }
@@ -167,6 +250,7 @@ CompilerWrapper::CompilerWrapper(int argc, char **argv)
 
     m_LLVMRuntime32Obj = joinPath(exeDir, std::string(LLVM_RUNTIME_OBJ_NAME) + ".32.o");
     m_LLVMRuntime64Obj = joinPath(exeDir, std::string(LLVM_RUNTIME_OBJ_NAME) + ".64.o");
+    m_LibFuzzerDriverObj = joinPath(exeDir, std::string(LIBFUZZER_DRIVER_OBJ_NAME) + ".o");
 
     m_arguments.resize(argc - 1);
     m_isInstrument = false;
@@ -183,7 +267,8 @@ CompilerWrapper::CompilerWrapper(int argc, char **argv)
 void CompilerWrapper::updateArguments()
 {
     std::vector<std::string> newArgs;
-    bool maybeLinking = true, isXSet = false, isASanSet = false, isFortifySet = false;
+    bool maybeLinking = true, isXSet = false, isASanSet = false, isFortifySet = false,
+         isLibFuzzer = false;
     unsigned bitMode = 0;
     std::string optionDistDir = std::string("-") + LLVM_OPT_DISTDIR_NAME;
     std::string optionProjRoot = std::string("-") + LLVM_OPT_PROJROOT_NAME;
@@ -222,10 +307,34 @@ void CompilerWrapper::updateArguments()
 
         if (curArg == "-c" || curArg == "-S" || curArg == "-E") maybeLinking = false;
 
+        // libFuzzer harnesses get the FGo driver instead of libFuzzer, so
+        // 'fuzzer' and 'fuzzer-no-link' are dropped from sanitizer lists
+        // such as '-fsanitize=fuzzer,address'
         if (curArg.compare(0, 11, "-fsanitize=") == 0) {
-            if (curArg.find("address") != std::string::npos ||
-                curArg.find("memory") != std::string::npos)
-                isASanSet = true;
+            std::string sanitizers;
+            size_t begin = 11;
+            while (begin <= curArg.size()) {
+                size_t end = curArg.find(',', begin);
+                if (end == std::string::npos) end = curArg.size();
+                std::string sanitizer = curArg.substr(begin, end - begin);
+                begin = end + 1;
+
+                if (sanitizer == "fuzzer") {
+                    isLibFuzzer = true;
+                    continue;
+                }
+                if (sanitizer == "fuzzer-no-link" || sanitizer.empty()) continue;
+
+                if (sanitizer.find("address") != std::string::npos ||
+                    sanitizer.find("memory") != std::string::npos)
+                    isASanSet = true;
+
+                if (!sanitizers.empty()) sanitizers += ",";
+                sanitizers += sanitizer;
+            }
+            if (sanitizers.empty()) continue;
+            newArgs.push_back("-fsanitize=" + sanitizers);
+            continue;
         }
 
         if (curArg.find("FORTIFY_SOURCE") != std::string::npos) isFortifySet = true;
@@ -331,6 +440,31 @@ void CompilerWrapper::updateArguments()
 #endif /* ^__APPLE__ */
                       "_I(); } while (0)");
 
+    // Shared memory test case delivery (AFL_SHM_FUZZ). A harness calls
+    // __AFL_FUZZ_INIT() once at file scope and then reads the test case from
+    // __AFL_FUZZ_TESTCASE_BUF, which is NULL when afl-fuzz didn't negotiate it.
+
+    newArgs.push_back("-D__AFL_FUZZ_INIT()="
+                      "int __afl_sharedmem_fuzzing = 1");
+
+    newArgs.push_back("-D__AFL_FUZZ_TESTCASE_BUF="
+                      "({ extern unsigned char *_F "
+#ifdef __APPLE__
+                      "__asm__(\"___afl_fuzz_ptr\"); "
+#else
+                      "__asm__(\"__afl_fuzz_ptr\"); "
+#endif /* ^__APPLE__ */
+                      "_F; })");
+
+    newArgs.push_back("-D__AFL_FUZZ_TESTCASE_LEN="
+                      "({ __attribute__((visibility(\"default\"))) "
+#ifdef __APPLE__
+                      "unsigned int _G(void) __asm__(\"___afl_fuzz_testcase_len\"); "
+#else
+                      "unsigned int _G(void) __asm__(\"__afl_fuzz_testcase_len\"); "
+#endif /* ^__APPLE__ */
+                      "_G(); })");
+
     if (maybeLinking) {
 
         if (isXSet) {
@@ -338,6 +472,14 @@ void CompilerWrapper::updateArguments()
             newArgs.push_back("none");
         }
 
+        if (isLibFuzzer) {
+            AbortOnError(
+                pathExists(m_LibFuzzerDriverObj) && pathIsFile(m_LibFuzzerDriverObj),
+                "'-fsanitize=fuzzer' is not supported by this compiler wrapper"
+            );
+            newArgs.push_back(m_LibFuzzerDriverObj);
+        }
+
         switch (bitMode) {
 
         case 0:
@@ -365,7 +507,7 @@ void CompilerWrapper::updateArguments()
     m_arguments = newArgs;
 }
 
-void CompilerWrapper::execute()
+std::string CompilerWrapper::getCompilerName()
 {
     std::string compilerName;
     // clang/clang++
@@ -379,6 +521,199 @@ void CompilerWrapper::execute()
         if (clangFromEnv) compilerName = clangFromEnv;
         else compilerName = COMPILER_CLANG_PATH;
     }
+    return compilerName;
+}
+
+int CompilerWrapper::runCompiler(const std::vector<std::string> &arguments)
+{
+    std::string compilerName = getCompilerName();
+
+    std::vector<char *> cStyleArgs;
+    cStyleArgs.push_back(const_cast<char *>(compilerName.c_str()));
+    for (const auto &arg : arguments) cStyleArgs.push_back(const_cast<char *>(arg.c_str()));
+    cStyleArgs.push_back(NULL);
+
+    pid_t pid = fork();
+    AbortOnError(pid >= 0, "Failed to fork the compiler process");
+    if (!pid) {
+        execvp(compilerName.c_str(), cStyleArgs.data());
+        _exit(127);
+    }
+
+    int status = 0;
+    if (waitpid(pid, &status, 0) <= 0) return 1;
+    if (WIFEXITED(status)) return WEXITSTATUS(status);
+    return 1;
+}
+
+int CompilerWrapper::executeWithCache()
+{
+    const char *cacheDir = getenv(OBJ_CACHE_DIR_ENVAR);
+    if (!cacheDir || !m_isInstrument) return -1;
+
+    // Only a compile-only invocation with a single source file and an explicit
+    // output is cacheable. Dependency files (-M*) would not be regenerated on
+    // a cache hit, so such invocations are always compiled.
+    std::string optionDistDir = std::string("-") + LLVM_OPT_DISTDIR_NAME + "=";
+    std::string optionProjRoot = std::string("-") + LLVM_OPT_PROJROOT_NAME + "=";
+    std::string distDir, projRoot, outFile, srcFile, flags;
+    std::vector<std::string> ppArgs;
+    bool isCompileOnly = false;
+    for (size_t i = 0; i < m_arguments.size(); ++i) {
+        const auto &curArg = m_arguments[i];
+        if (curArg == "-o") {
+            if (i + 1 >= m_arguments.size()) return -1;
+            outFile = m_arguments[++i];
+            continue;
+        }
+        if (curArg == "-E" || curArg == "-S" || curArg == "-" || curArg.compare(0, 2, "-M") == 0)
+            return -1;
+        if (curArg == "-c") {
+            isCompileOnly = true;
+            ppArgs.push_back("-E");
+            flags += curArg + "\n";
+            continue;
+        }
+
+        // The distance directory changes on every retargeting, so it is
+        // represented by the shard hashes instead of its path
+        if (curArg.compare(0, optionDistDir.size(), optionDistDir) == 0) {
+            distDir = curArg.substr(optionDistDir.size());
+            ppArgs.push_back(curArg);
+            continue;
+        }
+        if (curArg.compare(0, optionProjRoot.size(), optionProjRoot) == 0)
+            projRoot = curArg.substr(optionProjRoot.size());
+
+        if (!curArg.empty() && curArg[0] != '-' && isSourceFile(curArg)) {
+            if (!srcFile.empty()) return -1;
+            srcFile = curArg;
+        }
+        else flags += curArg + "\n";
+        ppArgs.push_back(curArg);
+    }
+    if (!isCompileOnly || srcFile.empty() || outFile.empty()) return -1;
+
+    if (distDir.empty() && getenv(DIST_DIR_ENVAR)) distDir = getenv(DIST_DIR_ENVAR);
+    if (projRoot.empty() && getenv(PROJ_ROOT_ENVAR)) projRoot = getenv(PROJ_ROOT_ENVAR);
+    if (distDir.empty()) return -1;
+
+    // Load the shard index emitted by the analyzer
+    std::string shardIndexFile =
+        joinPath(joinPath(distDir, DIST_SHARD_DIRNAME), DIST_SHARD_INDEX_FILENAME);
+    std::ifstream indexStream(shardIndexFile, std::ios::in);
+    if (!indexStream.is_open()) return -1;
+    std::unordered_map<std::string, std::string> shardHashes;
+    std::string shardKey, indexLine;
+    while (std::getline(indexStream, indexLine)) {
+        std::istringstream lineStream(indexLine);
+        std::string hash, shardName, srcPath;
+        if (indexLine.compare(0, 11, "TargetCount") == 0) shardKey += indexLine + "\n";
+        else if (std::getline(lineStream, hash, '\t') &&
+                 std::getline(lineStream, shardName, '\t') && std::getline(lineStream, srcPath))
+            shardHashes[srcPath] = hash;
+    }
+    indexStream.close();
+
+    AbortOnError(
+        createDirectoryIfMissing(cacheDir),
+        std::string("Failed to create the object cache directory ") + cacheDir
+    );
+
+    // Preprocess the translation unit
+    std::string pidStr = std::to_string(getpid());
+    std::string ppFile = joinPath(cacheDir, "preprocessed." + pidStr);
+    ppArgs.push_back("-o");
+    ppArgs.push_back(ppFile);
+    std::string ppContent;
+    if (runCompiler(ppArgs) != 0 || !readFileContent(ppFile, ppContent)) {
+        std::filesystem::remove(ppFile);
+        return -1;
+    }
+    std::filesystem::remove(ppFile);
+
+    // Collect the shard hashes of all the files included by this unit from
+    // the line markers. The lookup falls back to the file name in the same
+    // way as the LLVM pass does.
+    std::set<std::string> includedFiles;
+    std::istringstream ppStream(ppContent);
+    std::string ppLine;
+    while (std::getline(ppStream, ppLine)) {
+        if (ppLine.size() < 4 || ppLine[0] != '#' || ppLine[1] != ' ' || !isdigit(ppLine[2]))
+            continue;
+        size_t start = ppLine.find('"');
+        size_t end = ppLine.find('"', start + 1);
+        if (start == std::string::npos || end == std::string::npos) continue;
+        std::string includedFile = ppLine.substr(start + 1, end - start - 1);
+        if (!includedFile.empty() && includedFile[0] != '<') includedFiles.insert(includedFile);
+    }
+    std::error_code ec;
+    std::string realProjRoot;
+    if (!projRoot.empty()) realProjRoot = std::filesystem::weakly_canonical(projRoot, ec).string();
+    for (const auto &includedFile : includedFiles) {
+        std::string filePath = std::filesystem::weakly_canonical(includedFile, ec).string();
+        if (ec) filePath = includedFile;
+        if (!realProjRoot.empty() && filePath.compare(0, realProjRoot.size(), realProjRoot) == 0 &&
+            filePath.size() > realProjRoot.size() && filePath[realProjRoot.size()] == '/')
+            filePath = filePath.substr(realProjRoot.size() + 1);
+        std::string fileName = std::filesystem::path(filePath).filename().string();
+        if (shardHashes.find(filePath) != shardHashes.end())
+            shardKey += filePath + ":" + shardHashes[filePath] + "\n";
+        else if (shardHashes.find(fileName) != shardHashes.end())
+            shardKey += fileName + ":" + shardHashes[fileName] + "\n";
+    }
+
+    // So is the point of the deferred fork server when it is inserted
+    std::string deferPointContent;
+    if (getenv(AUTO_DEFER_ENVAR) &&
+        readFileContent(joinPath(distDir, std::string(DEFER_POINT_FILENAME) + ".json"),
+                        deferPointContent))
+        shardKey += "defer:" + getHashString(getFNVHash(deferPointContent)) + "\n";
+
+    // And the distances the dictionary tokens are collected and ASan is kept within
+    if (getenv(DICT_MAX_DIST_ENVAR))
+        shardKey += std::string("dict:") + getenv(DICT_MAX_DIST_ENVAR) + "\n";
+    if (getenv(ASAN_MAX_DIST_ENVAR))
+        shardKey += std::string("asan:") + getenv(ASAN_MAX_DIST_ENVAR) + "\n";
+
+    // The pass library and the compiler are part of the key as well
+    std::string toolKey = getCompilerName() + "\n";
+    if (pathIsFile(m_LLVMPassLib)) {
+        toolKey += std::to_string(std::filesystem::file_size(m_LLVMPassLib, ec)) + ":" +
+                   std::to_string(
+                       std::filesystem::last_write_time(m_LLVMPassLib, ec).time_since_epoch().count()
+                   );
+    }
+
+    std::string cacheKey = getHashString(getFNVHash(ppContent)) +
+                           getHashString(getFNVHash(shardKey, getFNVHash(flags + toolKey)));
+    std::string cachedObj = joinPath(cacheDir, cacheKey + ".o");
+
+    // Copy atomically, since parallel builds may share the cache. What the
+    // pass computes for the fuzzer is embedded into the object, so the
+    // object is all there is to cache.
+    auto publishFile = [&pidStr, &ec](const std::string &fromPath, const std::string &toPath) {
+        std::string tmpPath = toPath + "." + pidStr;
+        if (copyFile(fromPath, tmpPath)) {
+            std::filesystem::rename(tmpPath, toPath, ec);
+            if (ec) std::filesystem::remove(tmpPath, ec);
+        }
+    };
+
+    bool isQuiet = !isatty(2) || getenv("AFL_QUIET");
+    if (pathIsFile(cachedObj) && copyFile(cachedObj, outFile)) {
+        if (!isQuiet) SucceedSome(COMPILER_HINT, "(Reused cached object for " + srcFile + ")");
+        return 0;
+    }
+
+    int status = runCompiler(m_arguments);
+    if (status == 0 && pathIsFile(outFile)) publishFile(outFile, cachedObj);
+    return status;
+}
+
+void CompilerWrapper::execute()
+{
+    std::string compilerName = getCompilerName();
 
     char **cStyleArgs = new char *[m_arguments.size() + 2];
     cStyleArgs[0] = new char[compilerName.size() + 1];
@@ -425,6 +760,9 @@ int main(int argc, char **argv)
 
     compiler.updateArguments();
 
+    int status = compiler.executeWithCache();
+    if (status >= 0) return status;
+
     compiler.execute();
 
     return 0;
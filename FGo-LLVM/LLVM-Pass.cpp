@@ -33,6 +33,7 @@
 
 #define AFL_LLVM_PASS
 
+#include "../AFL-Fuzz/cmplog.h"
 #include "../AFL-Fuzz/config.h"
 #include "../AFL-Fuzz/types.h"
 #include "../Utility/FGoDefs.h"
@@ -40,7 +41,10 @@
 
 #include "llvm/Config/llvm-config.h"
 #include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/CFG.h"
 #include "llvm/IR/DebugInfo.h"
+#include "llvm/IR/InstrTypes.h"
+#include "llvm/IR/Instructions.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Pass.h"
@@ -48,6 +52,7 @@
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Path.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
 
 /* use new pass manager */
 #include "llvm/IR/PassManager.h"
@@ -56,8 +61,12 @@
 
 #include "json/json.h"
 #include <cstdlib>
+#include <algorithm>
 #include <fstream>
+#include <map>
 #include <unordered_map>
+#include <unordered_set>
+#include <unistd.h>
 
 using namespace llvm;
 
@@ -278,6 +287,298 @@ bool parseDistMapFromJsonFile(
     return true;
 }
 
+/// @brief Insert a call to `__afl_manual_init` into `main` at the point found
+/// by the analyzer, and mark the module for the deferred fork server
+/// @param M
+/// @param deferPointFile
+/// @param projRootDir
+/// @param pointLoc the chosen location as "file:line"
+/// @return false if the point file is unusable or the point isn't in `main`,
+/// including when `main` doesn't have the blocks the analyzer saw
+bool insertDeferredInit(
+    Module &M, const std::string &deferPointFile, const std::string &projRootDir,
+    std::string &pointLoc
+)
+{
+    Json::Value root;
+    std::ifstream ifs(deferPointFile, std::ios::in);
+    if (!ifs.is_open() || !parseJsonValueFromFile(ifs, root)) return false;
+    ifs.close();
+
+    if (!root.isObject() || !root["Found"].asBool() || !root["File"].isString() ||
+        !root["Line"].isUInt() || !root["Block"].isUInt() || !root["BlockCount"].isUInt())
+        return false;
+    std::string pointFile = root["File"].asString();
+    unsigned pointLine = root["Line"].asUInt();
+    pointLoc = pointFile + ":" + std::to_string(pointLine);
+
+    Function *mainFunc = M.getFunction("main");
+    if (!mainFunc || mainFunc->isDeclaration()) return false;
+
+    // The block the analyzer chose, which only makes sense if `main` still
+    // has the blocks it analyzed
+    if (mainFunc->size() != root["BlockCount"].asUInt() ||
+        root["Block"].asUInt() >= mainFunc->size())
+        return false;
+    BasicBlock &pointBB = *std::next(mainFunc->begin(), root["Block"].asUInt());
+
+    // The first instruction at the location in that block. The file is
+    // matched by either the relative path or the file name, as for the
+    // distances.
+    Instruction *insertPoint = nullptr;
+    for (auto &I : pointBB) {
+        std::string filePath, fileName;
+        unsigned line = 0;
+        getDebugLocWithPath(&I, filePath, fileName, line, projRootDir);
+        if (line == pointLine && (filePath == pointFile || fileName == pointFile)) {
+            insertPoint = &I;
+            break;
+        }
+    }
+    if (!insertPoint) return false;
+    if (isa<PHINode>(insertPoint) || insertPoint->isEHPad())
+        insertPoint = &(*insertPoint->getParent()->getFirstInsertionPt());
+
+    LLVMContext &C = M.getContext();
+    FunctionCallee initFunc =
+        M.getOrInsertFunction("__afl_manual_init", FunctionType::get(Type::getVoidTy(C), false));
+    IRBuilder<> IRB(insertPoint);
+    IRB.CreateCall(initFunc);
+
+    // afl-fuzz looks for this signature to tell the runtime not to start the
+    // fork server in its constructor
+    Constant *deferSig = ConstantDataArray::getString(C, DEFER_SIG);
+    GlobalVariable *deferSigVar = new GlobalVariable(
+        M, deferSig->getType(), true, GlobalValue::PrivateLinkage, deferSig, "__fgo_defer_sig"
+    );
+    appendToUsed(M, {deferSigVar});
+
+    return true;
+}
+
+/// @brief Embed constant data into a section of the object of a module. The
+/// linker concatenates the sections of the same name of all the objects of
+/// a binary, so the fuzzer reading them back from the binary only sees the
+/// modules linked into it, however many objects the sources were compiled to.
+/// The name of the section must be a C identifier, which keeps ASan from
+/// padding the data.
+/// @param M
+/// @param data
+/// @param section
+/// @param name
+void embedInSection(Module &M, Constant *data, const char *section, const std::string &name)
+{
+    GlobalVariable *GV = new GlobalVariable(
+        M, data->getType(), true, GlobalValue::PrivateLinkage, data, name
+    );
+    GV->setSection(section);
+    GV->setAlignment(Align(data->getType()->getArrayElementType()->getPrimitiveSizeInBits() / 8));
+    appendToUsed(M, {GV});
+}
+
+/// @brief Compute the bitmap indices of the edges into the blocks that can
+/// reach a target, i.e. those with a DF or BT distance. The index of an edge
+/// is `cur_loc(dst) ^ (cur_loc(src) >> 1)`, so only edges whose source is
+/// known statically are marked: CFG edges within a function, and the edges
+/// from direct call sites into the entry block of a function in this module.
+/// @param M
+/// @param bbLocs the `cur_loc` of every instrumented block
+/// @param reachBBs the instrumented blocks with a distance
+/// @param reachMask the bitmap of MAP_SIZE bits to fill
+/// @return the number of edges marked
+size_t computeReachMask(
+    Module &M, const std::unordered_map<BasicBlock *, unsigned> &bbLocs,
+    const std::unordered_set<BasicBlock *> &reachBBs, std::vector<u8> &reachMask
+)
+{
+    size_t edgeCount = 0;
+
+    auto markEdge = [&](BasicBlock *srcBB, unsigned dstLoc) {
+        auto srcIter = bbLocs.find(srcBB);
+        if (srcIter == bbLocs.end()) return;
+        unsigned index = dstLoc ^ (srcIter->second >> 1);
+        if (!(reachMask[index >> 3] & (1 << (index & 7)))) {
+            reachMask[index >> 3] |= 1 << (index & 7);
+            ++edgeCount;
+        }
+    };
+
+    for (BasicBlock *BB : reachBBs) {
+        unsigned dstLoc = bbLocs.at(BB);
+
+        for (BasicBlock *predBB : predecessors(BB)) markEdge(predBB, dstLoc);
+
+        Function *F = BB->getParent();
+        if (BB != &F->getEntryBlock()) continue;
+        for (User *U : F->users()) {
+            CallBase *CB = dyn_cast<CallBase>(U);
+            if (CB && CB->getCalledFunction() == F) markEdge(CB->getParent(), dstLoc);
+        }
+    }
+
+    return edgeCount;
+}
+
+/// @brief Collect the dictionary tokens used by a block: constant strings,
+/// and the immediates of switch cases and integer comparisons, as stored in
+/// memory. Immediates fitting in a (sign-extended) byte are left to the
+/// deterministic stages of the fuzzer.
+/// @param BB
+/// @param tokens
+void collectDictTokens(BasicBlock &BB, std::vector<std::string> &tokens)
+{
+    auto addImmediate = [&tokens](const ConstantInt *CI) {
+        unsigned width = CI->getBitWidth();
+        if (width < 16 || width > 64 || width % 8) return;
+        int64_t value = CI->getSExtValue();
+        if (value >= -128 && value <= 255) return;
+        uint64_t bits = CI->getZExtValue();
+        std::string token;
+        for (unsigned i = 0; i < width / 8; ++i) token.push_back((char)(bits >> (i * 8)));
+        tokens.push_back(token);
+    };
+
+    for (auto &I : BB) {
+        if (SwitchInst *SI = dyn_cast<SwitchInst>(&I)) {
+            for (auto &Case : SI->cases()) addImmediate(Case.getCaseValue());
+        }
+        else if (ICmpInst *ICmp = dyn_cast<ICmpInst>(&I)) {
+            for (Value *Op : ICmp->operands())
+                if (ConstantInt *CI = dyn_cast<ConstantInt>(Op)) addImmediate(CI);
+        }
+
+        for (Value *Op : I.operands()) {
+            GlobalVariable *GV = dyn_cast<GlobalVariable>(Op->stripPointerCasts());
+            if (!GV || !GV->isConstant() || !GV->hasInitializer()) continue;
+            ConstantDataSequential *CDS = dyn_cast<ConstantDataSequential>(GV->getInitializer());
+            if (!CDS || !CDS->isString()) continue;
+            std::string token = CDS->isCString() ? CDS->getAsCString().str()
+                                                 : CDS->getAsString().str();
+            if (token.size() >= 2 && token.size() <= MAX_AUTO_EXTRA) tokens.push_back(token);
+        }
+    }
+}
+
+/// @brief Format the dictionary of a module in the format of `afl-fuzz -x`,
+/// nearest tokens first. The label of a token holds its distance.
+/// @param moduleId
+/// @param tokenDists
+/// @return
+std::string formatDictionary(
+    const std::string &moduleId, const std::map<std::string, int32_t> &tokenDists
+)
+{
+    std::vector<std::pair<int32_t, std::string>> sortedTokens;
+    for (auto &item : tokenDists) sortedTokens.push_back({item.second, item.first});
+    std::sort(sortedTokens.begin(), sortedTokens.end());
+
+    std::string content = "# Tokens near the targets in " + moduleId + ", nearest first\n";
+    for (auto &item : sortedTokens) {
+        content += "dist_" + std::to_string(item.first) + "=\"";
+        for (unsigned char c : item.second) {
+            if (c >= 32 && c < 127 && c != '"' && c != '\\') content.push_back(c);
+            else {
+                char escaped[5];
+                snprintf(escaped, sizeof(escaped), "\\x%02x", c);
+                content += escaped;
+            }
+        }
+        content += "\"\n";
+    }
+    return content;
+}
+
+/// @brief Log the operands of the integer comparisons and of the calls to
+/// strcmp()/memcmp()-style routines in a block into the CmpLog table
+/// @param BB
+/// @param insHook `__fgo_cmplog_ins(u32 id, u64 v0, u64 v1, u8 size)`
+/// @param rtnHook `__fgo_cmplog_rtn(u32 id, u8 *p0, u8 *p1, u64 n, u8 is_str)`
+/// @return the number of comparisons instrumented
+size_t instrumentCmpLog(BasicBlock &BB, FunctionCallee insHook, FunctionCallee rtnHook)
+{
+    // Routine name -> (index of the length argument or -1, string routine)
+    static const std::unordered_map<std::string, std::pair<int, bool>> cmpRoutines = {
+        {"strcmp", {-1, true}},     {"strcasecmp", {-1, true}}, {"strncmp", {2, true}},
+        {"strncasecmp", {2, true}}, {"memcmp", {2, false}},     {"bcmp", {2, false}}
+    };
+
+    std::vector<ICmpInst *> icmps;
+    std::vector<CallBase *> calls;
+
+    for (auto &I : BB) {
+        if (ICmpInst *ICmp = dyn_cast<ICmpInst>(&I)) {
+            IntegerType *OpTy = dyn_cast<IntegerType>(ICmp->getOperand(0)->getType());
+            if (!OpTy) continue;
+            unsigned width = OpTy->getBitWidth();
+            if (width != 8 && width != 16 && width != 32 && width != 64) continue;
+            if (isa<Constant>(ICmp->getOperand(0)) && isa<Constant>(ICmp->getOperand(1)))
+                continue;
+            icmps.push_back(ICmp);
+        }
+        else if (CallBase *CB = dyn_cast<CallBase>(&I)) {
+            Function *Callee = CB->getCalledFunction();
+            if (!Callee || cmpRoutines.find(Callee->getName().str()) == cmpRoutines.end())
+                continue;
+            if (CB->arg_size() < 2 || !CB->getArgOperand(0)->getType()->isPointerTy() ||
+                !CB->getArgOperand(1)->getType()->isPointerTy())
+                continue;
+            calls.push_back(CB);
+        }
+    }
+
+    for (ICmpInst *ICmp : icmps) {
+        IRBuilder<> IRB(ICmp);
+        unsigned size = ICmp->getOperand(0)->getType()->getIntegerBitWidth() / 8;
+        IRB.CreateCall(
+            insHook, {IRB.getInt32(AFL_R(CMP_MAP_W)),
+                      IRB.CreateZExt(ICmp->getOperand(0), IRB.getInt64Ty()),
+                      IRB.CreateZExt(ICmp->getOperand(1), IRB.getInt64Ty()), IRB.getInt8(size)}
+        );
+    }
+
+    for (CallBase *CB : calls) {
+        IRBuilder<> IRB(CB);
+        auto routine = cmpRoutines.at(CB->getCalledFunction()->getName().str());
+        Value *len = IRB.getInt64(CMP_RTN_UNBOUNDED);
+        if (routine.first >= 0 && (unsigned)routine.first < CB->arg_size() &&
+            CB->getArgOperand(routine.first)->getType()->isIntegerTy())
+            len = IRB.CreateZExtOrTrunc(CB->getArgOperand(routine.first), IRB.getInt64Ty());
+        IRB.CreateCall(
+            rtnHook, {IRB.getInt32(AFL_R(CMP_MAP_W)),
+                      IRB.CreatePointerCast(CB->getArgOperand(0), IRB.getInt8PtrTy()),
+                      IRB.CreatePointerCast(CB->getArgOperand(1), IRB.getInt8PtrTy()), len,
+                      IRB.getInt8(routine.second)}
+        );
+    }
+
+    return icmps.size() + calls.size();
+}
+
+/// @brief Keep ASan only in the functions within a distance of a target.
+/// This pass runs before ASan, which leaves out the functions without the
+/// `sanitize_address` attribute, as if they were `no_sanitize("address")`.
+/// @param M
+/// @param funcDist the minimal DF or BT distance of the functions having one
+/// @param maxDist
+/// @param total the number of functions that were to be sanitized
+/// @return the number of functions left sanitized
+size_t restrictAddressSanitizer(
+    Module &M, const std::unordered_map<Function *, int32_t> &funcDist, int32_t maxDist,
+    size_t &total
+)
+{
+    size_t sanitized = 0;
+    total = 0;
+    for (auto &F : M) {
+        if (F.isDeclaration() || !F.hasFnAttribute(Attribute::SanitizeAddress)) continue;
+        ++total;
+        auto it = funcDist.find(&F);
+        if (it != funcDist.end() && it->second <= maxDist) ++sanitized;
+        else F.removeFnAttr(Attribute::SanitizeAddress);
+    }
+    return sanitized;
+}
+
 } // namespace FGo
 
 PreservedAnalyses FGoModulePass::run(Module &M, ModuleAnalysisManager &MAM)
@@ -296,7 +597,9 @@ PreservedAnalyses FGoModulePass::run(Module &M, ModuleAnalysisManager &MAM)
     }
     else {
         if (isatty(2) && !getenv("AFL_QUIET")) {
-            if (getenv("AFL_USE_ASAN"))
+            if (getenv("AFL_USE_ASAN") && getenv(ASAN_MAX_DIST_ENVAR))
+                FGo::HighlightSome(COMPILER_HINT, "(Instrumentation | Selective ASan)");
+            else if (getenv("AFL_USE_ASAN"))
                 FGo::HighlightSome(COMPILER_HINT, "(Instrumentation | ASan)");
             else FGo::HighlightSome(COMPILER_HINT, "(Instrumentation | Non-Asan)");
         }
@@ -398,6 +701,7 @@ PreservedAnalyses FGoModulePass::run(Module &M, ModuleAnalysisManager &MAM)
     IntegerType *LargestType = Int32Ty;
     #endif
 
+    // Distance slot of a target, laid out by the FGO_DIST_SLOT_* offsets:
     // [Count for DF] | [DF Dist] | [Count for BT] | [BT Dist]  | [Minimal Dist]
     // 0------------7 | 8------15 | 16----------23 | 24------31 | 32----------39 (byte)
 
@@ -407,11 +711,12 @@ PreservedAnalyses FGoModulePass::run(Module &M, ModuleAnalysisManager &MAM)
     std::vector<ConstantInt *> btMapDistLocations(targetCount, nullptr);
     std::vector<ConstantInt *> minMapDistLocations(targetCount, nullptr);
     for (size_t i = 0; i < targetCount; ++i) {
-        dfMapCntLocations[i] = ConstantInt::get(LargestType, MAP_SIZE + i * 40);
-        dfMapDistLocations[i] = ConstantInt::get(LargestType, MAP_SIZE + i * 40 + 8);
-        btMapCntLocations[i] = ConstantInt::get(LargestType, MAP_SIZE + i * 40 + 16);
-        btMapDistLocations[i] = ConstantInt::get(LargestType, MAP_SIZE + i * 40 + 24);
-        minMapDistLocations[i] = ConstantInt::get(LargestType, MAP_SIZE + i * 40 + 32);
+        size_t slot = MAP_SIZE + i * FGO_DIST_SLOT_SIZE;
+        dfMapCntLocations[i] = ConstantInt::get(LargestType, slot + FGO_DIST_SLOT_DF_CNT_OFFSET);
+        dfMapDistLocations[i] = ConstantInt::get(LargestType, slot + FGO_DIST_SLOT_DF_DIST_OFFSET);
+        btMapCntLocations[i] = ConstantInt::get(LargestType, slot + FGO_DIST_SLOT_BT_CNT_OFFSET);
+        btMapDistLocations[i] = ConstantInt::get(LargestType, slot + FGO_DIST_SLOT_BT_DIST_OFFSET);
+        minMapDistLocations[i] = ConstantInt::get(LargestType, slot + FGO_DIST_SLOT_MIN_OFFSET);
     }
     ConstantInt *One = ConstantInt::get(LargestType, 1);
 
@@ -425,6 +730,31 @@ PreservedAnalyses FGoModulePass::run(Module &M, ModuleAnalysisManager &MAM)
         GlobalVariable::GeneralDynamicTLSModel, 0, false
     );
 
+    // Locations of the instrumented blocks, and the blocks that can reach a
+    // target, for the reach mask
+    std::unordered_map<BasicBlock *, unsigned> bbLocs;
+    std::unordered_set<BasicBlock *> reachBBs;
+
+    // Hooks logging the comparisons in the blocks with a DF distance, for the
+    // input-to-state stage of the fuzzer
+    size_t cmpLogCount = 0;
+    FunctionCallee cmpLogInsHook = M.getOrInsertFunction(
+        "__fgo_cmplog_ins", Type::getVoidTy(C), Int32Ty, Int64Ty, Int64Ty, Int8Ty
+    );
+    FunctionCallee cmpLogRtnHook = M.getOrInsertFunction(
+        "__fgo_cmplog_rtn", Type::getVoidTy(C), Int32Ty, PointerType::get(Int8Ty, 0),
+        PointerType::get(Int8Ty, 0), Int64Ty, Int8Ty
+    );
+
+    // Dictionary tokens of the blocks, and the minimal DF distances of the
+    // blocks and of the functions they belong to
+    std::vector<std::pair<BasicBlock *, std::string>> bbTokens;
+    std::unordered_map<BasicBlock *, int32_t> bbMinDist;
+    std::unordered_map<Function *, int32_t> funcMinDist;
+
+    // Minimal DF or BT distances of the functions, for selective ASan
+    std::unordered_map<Function *, int32_t> funcSanDist;
+
     // Interate
     for (auto &F : M) {
 
@@ -476,6 +806,34 @@ PreservedAnalyses FGoModulePass::run(Module &M, ModuleAnalysisManager &MAM)
                 }
             }
 
+            // Tokens are collected and comparisons are logged first, so
+            // that the instructions inserted below are left out
+            {
+                std::vector<std::string> tokens;
+                collectDictTokens(BB, tokens);
+                for (auto &token : tokens) bbTokens.push_back({&BB, token});
+            }
+            for (size_t i = 0; i < targetCount; ++i) {
+                if (dfDistance[i] < 0) continue;
+                if (bbMinDist.find(&BB) == bbMinDist.end() || dfDistance[i] < bbMinDist[&BB])
+                    bbMinDist[&BB] = dfDistance[i];
+                if (funcMinDist.find(&F) == funcMinDist.end() || dfDistance[i] < funcMinDist[&F])
+                    funcMinDist[&F] = dfDistance[i];
+            }
+            for (size_t i = 0; i < targetCount; ++i) {
+                int32_t distance = dfDistance[i] >= 0 ? dfDistance[i] : btDistance[i];
+                if (distance < 0) continue;
+                if (funcSanDist.find(&F) == funcSanDist.end() || distance < funcSanDist[&F])
+                    funcSanDist[&F] = distance;
+            }
+
+            for (size_t i = 0; i < targetCount; ++i) {
+                if (dfDistance[i] >= 0) {
+                    cmpLogCount += instrumentCmpLog(BB, cmpLogInsHook, cmpLogRtnHook);
+                    break;
+                }
+            }
+
             BasicBlock::iterator IP = BB.getFirstInsertionPt();
             // if (IP == BB.end()) continue;
             IRBuilder<> IRB(&(*IP));
@@ -483,6 +841,7 @@ PreservedAnalyses FGoModulePass::run(Module &M, ModuleAnalysisManager &MAM)
             // Current location
             unsigned int cur_loc = AFL_R(MAP_SIZE);
             ConstantInt *CurLoc = ConstantInt::get(Int32Ty, cur_loc);
+            bbLocs[&BB] = cur_loc;
 
             // Load previous location
             LoadInst *PrevLoc = IRB.CreateLoad(IRB.getInt32Ty(), AFLPrevLoc);
@@ -582,21 +941,110 @@ PreservedAnalyses FGoModulePass::run(Module &M, ModuleAnalysisManager &MAM)
                 }
             }
 
-            if (findBBDist) ++instrBBCount;
+            if (findBBDist) {
+                ++instrBBCount;
+                for (size_t i = 0; i < targetCount; ++i) {
+                    if (dfDistance[i] >= 0 || btDistance[i] >= 0) {
+                        reachBBs.insert(&BB);
+                        break;
+                    }
+                }
+            }
         }
     }
 
+    // Edges of this module reaching a target, embedded into the object
+    // since their indices are random on every compilation
+    std::vector<u8> reachMask(MAP_SIZE >> 3, 0);
+    size_t reachEdgeCount = computeReachMask(M, bbLocs, reachBBs, reachMask);
+    if (reachEdgeCount) {
+        std::vector<uint32_t> reachEdges;
+        for (uint32_t i = 0; i < MAP_SIZE; ++i)
+            if (reachMask[i >> 3] & (1 << (i & 7))) reachEdges.push_back(i + 1);
+        embedInSection(
+            M, ConstantDataArray::get(C, reachEdges), REACH_EDGES_SECTION, "__fgo_reach_edges"
+        );
+    }
+
+    // Dictionary of the tokens used by the functions within the maximal
+    // distance of a target, embedded into the object. A token gets the
+    // distance of the block using it, or of the function when the block has
+    // none.
+    int32_t maxDictDist = FGO_DICT_MAX_DIST;
+    if (getenv(DICT_MAX_DIST_ENVAR)) maxDictDist = atoi(getenv(DICT_MAX_DIST_ENVAR));
+
+    std::map<std::string, int32_t> tokenDists;
+    for (auto &item : bbTokens) {
+        int32_t distance;
+        if (bbMinDist.find(item.first) != bbMinDist.end()) distance = bbMinDist[item.first];
+        else if (funcMinDist.find(item.first->getParent()) != funcMinDist.end())
+            distance = funcMinDist[item.first->getParent()];
+        else continue;
+        if (distance > maxDictDist) continue;
+        if (tokenDists.find(item.second) == tokenDists.end() ||
+            distance < tokenDists[item.second])
+            tokenDists[item.second] = distance;
+    }
+
+    if (!tokenDists.empty()) {
+        embedInSection(
+            M,
+            ConstantDataArray::getString(
+                C, formatDictionary(M.getModuleIdentifier(), tokenDists), false
+            ),
+            TARGET_DICT_SECTION, "__fgo_target_dict"
+        );
+    }
+
+    // Selective ASan: only the functions near the targets stay sanitized
+    size_t asanFuncCount = 0, asanSanitizedCount = 0;
+    if (getenv(ASAN_MAX_DIST_ENVAR)) {
+        asanSanitizedCount = restrictAddressSanitizer(
+            M, funcSanDist, atoi(getenv(ASAN_MAX_DIST_ENVAR)), asanFuncCount
+        );
+    }
+
+    // Deferred fork server
+    bool isDeferInserted = false;
+    std::string deferPointLoc;
+    if (getenv(AUTO_DEFER_ENVAR) && M.getFunction("main") &&
+        !M.getFunction("main")->isDeclaration())
+    {
+        basePath = finalDistanceDir;
+        sys::path::append(basePath, std::string(DEFER_POINT_FILENAME) + ".json");
+        isDeferInserted =
+            insertDeferredInit(M, basePath.str().str(), projRootDir, deferPointLoc);
+        WarnOnError(
+            isDeferInserted, "Failed to insert the deferred fork server at the point in " +
+                                 basePath.str().str()
+        );
+    }
+
     // Some hints
     if (isatty(2) && !getenv("AFL_QUIET")) {
+        if (isDeferInserted)
+            SucceedSome("[+]", "Deferred fork server inserted at " + deferPointLoc);
+
         if (instrBBCount == 0) {
             WarnOnError(false, "Failed to find instrumentation targets");
         }
         else {
             SucceedSome(
                 "[+]",
-                std::string("Instrumented ") + std::to_string(instrBBCount) + " basic blocks"
+                std::string("Instrumented ") + std::to_string(instrBBCount) +
+                    " basic blocks, " + std::to_string(reachEdgeCount) +
+                    " edges reaching targets, " + std::to_string(cmpLogCount) +
+                    " comparisons logged, " + std::to_string(tokenDists.size()) +
+                    " dictionary tokens"
             );
         }
+
+        if (asanFuncCount > 0)
+            SucceedSome(
+                "[+]", std::string("ASan kept in ") + std::to_string(asanSanitizedCount) +
+                           " of " + std::to_string(asanFuncCount) +
+                           " functions within distance " + getenv(ASAN_MAX_DIST_ENVAR)
+            );
     }
 
     return PA;
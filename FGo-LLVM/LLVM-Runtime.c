@@ -12,6 +12,7 @@
 
 */
 
+#include "../AFL-Fuzz/cmplog.h"
 #include "../AFL-Fuzz/config.h"
 #include "../AFL-Fuzz/types.h"
 #include "../Utility/FGoDefs.h"
@@ -23,6 +24,7 @@
 #include <string.h>
 #include <sys/mman.h>
 #include <sys/shm.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
@@ -70,7 +72,7 @@
    is used for instrumentation output before __afl_map_shm() has a chance to run.
    It will end up as .comm, so it shouldn't be too wasteful. */
 
-u8 __afl_area_initial[MAP_SIZE + FGO_TARGET_MAX_COUNT * 40];
+u8 __afl_area_initial[MAP_SIZE + FGO_TARGET_MAX_COUNT * FGO_DIST_SLOT_SIZE];
 u8 *__afl_area_ptr = __afl_area_initial;
 
 __thread u32 __afl_prev_loc;
@@ -79,6 +81,26 @@ __thread u32 __afl_prev_loc;
 
 static u8 is_persistent;
 
+/* Test case delivered through shared memory by afl-fuzz (AFL_SHM_FUZZ). The
+   segment holds a 4-byte length followed by the data. __afl_fuzz_ptr stays
+   NULL unless afl-fuzz accepted FS_OPT_SHDMEM_FUZZ in the fork server
+   handshake; __afl_fuzz_buf is the attached segment itself. */
+
+u8 *__afl_fuzz_ptr;
+static u8 *__afl_fuzz_buf;
+static u32 *__afl_fuzz_len_ptr;
+static u32 __afl_fuzz_opts;
+static s32 __afl_fuzz_stdin_fd = -1;
+
+/* Defined as 1 by __AFL_FUZZ_INIT() in harnesses that read __afl_fuzz_ptr
+   directly. Otherwise, the runtime backs stdin with the shared test case. */
+
+__attribute__((weak)) int __afl_sharedmem_fuzzing;
+
+/* Comparison log table of the input-to-state stage, if afl-fuzz set it up. */
+
+static struct cmp_map *__fgo_cmp_map;
+
 /* SHM setup. */
 
 static void __afl_map_shm(void)
@@ -105,6 +127,50 @@ static void __afl_map_shm(void)
 
         __afl_area_ptr[0] = 1;
     }
+
+    id_str = getenv(SHM_FUZZ_ENV_VAR);
+
+    if (id_str) {
+
+        u8 *map = shmat(atoi(id_str), NULL, 0);
+
+        if (map == (void *)-1) _exit(1);
+
+        __afl_fuzz_len_ptr = (u32 *)map;
+        __afl_fuzz_buf = map + 4;
+    }
+
+    id_str = getenv(CMPLOG_SHM_ENV_VAR);
+
+    if (id_str) {
+
+        struct cmp_map *map = shmat(atoi(id_str), NULL, 0);
+
+        if (map == (void *)-1) _exit(1);
+
+        __fgo_cmp_map = map;
+    }
+}
+
+/* Length of the test case in the shared buffer. */
+
+u32 __afl_fuzz_testcase_len(void)
+{
+    return __afl_fuzz_ptr ? *__afl_fuzz_len_ptr : 0;
+}
+
+/* Replace stdin with an in-memory file holding the current test case, so that
+   targets reading stdin don't need afl-fuzz to write the test case out. */
+
+static void __afl_fuzz_fill_stdin(void)
+{
+
+    u32 len = *__afl_fuzz_len_ptr;
+
+    if (ftruncate(__afl_fuzz_stdin_fd, 0)) _exit(1);
+    if (pwrite(__afl_fuzz_stdin_fd, __afl_fuzz_buf, len, 0) != len) _exit(1);
+    lseek(__afl_fuzz_stdin_fd, 0, SEEK_SET);
+    dup2(__afl_fuzz_stdin_fd, 0);
 }
 
 /* Fork server logic. */
@@ -112,15 +178,41 @@ static void __afl_map_shm(void)
 static void __afl_start_forkserver(void)
 {
 
-    static u8 tmp[4];
+    u32 hello = 0;
     s32 child_pid;
 
     u8 child_stopped = 0;
 
+    /* Advertise how we can consume a test case from shared memory. */
+
+    if (__afl_fuzz_buf) {
+
+        if (__afl_sharedmem_fuzzing) hello = FS_OPT_ENABLED | FS_OPT_SHDMEM_FUZZ;
+
+#ifdef SYS_memfd_create
+        else {
+
+            __afl_fuzz_stdin_fd = syscall(SYS_memfd_create, "afl_stdin", 0);
+            if (__afl_fuzz_stdin_fd >= 0) hello = FS_OPT_ENABLED | FS_OPT_SHDMEM_STDIN;
+        }
+#endif /* SYS_memfd_create */
+    }
+
     /* Phone home and tell the parent that we're OK. If parent isn't there,
        assume we're not running in forkserver mode and just execute program. */
 
-    if (write(FORKSRV_FD + 1, tmp, 4) != 4) return;
+    if (write(FORKSRV_FD + 1, &hello, 4) != 4) return;
+
+    /* The parent replies with the options it accepted. Without any, the
+       test case keeps coming through files and the buffer stays hidden. */
+
+    if (hello) {
+
+        if (read(FORKSRV_FD, &__afl_fuzz_opts, 4) != 4) _exit(1);
+
+        __afl_fuzz_opts &= hello & ~FS_OPT_ENABLED;
+        if (__afl_fuzz_opts & FS_OPT_SHDMEM_FUZZ) __afl_fuzz_ptr = __afl_fuzz_buf;
+    }
 
     while (1) {
 
@@ -131,6 +223,17 @@ static void __afl_start_forkserver(void)
 
         if (read(FORKSRV_FD, &was_killed, 4) != 4) _exit(1);
 
+        /* The test case length follows when it is delivered through shared
+           memory. Keep it in the segment so a stopped persistent child sees
+           it as well. */
+
+        if (__afl_fuzz_opts) {
+
+            u32 len;
+            if (read(FORKSRV_FD, &len, 4) != 4) _exit(1);
+            *__afl_fuzz_len_ptr = len;
+        }
+
         /* If we stopped the child in persistent mode, but there was a race
            condition and afl-fuzz already issued SIGKILL, write off the old
            process. */
@@ -153,6 +256,7 @@ static void __afl_start_forkserver(void)
 
                 close(FORKSRV_FD);
                 close(FORKSRV_FD + 1);
+                if (__afl_fuzz_opts & FS_OPT_SHDMEM_STDIN) __afl_fuzz_fill_stdin();
                 return;
             }
         }
@@ -183,7 +287,28 @@ static void __afl_start_forkserver(void)
     }
 }
 
-/* A simplified persistent mode handler, used as explained in README.llvm. */
+/* Reset the bitmap and the distance region to the state afl-fuzz expects
+   before a run: all counters and distance sums cleared, and the minimal
+   distance slots seeded with INT32_MAX so that the instrumented select-min
+   picks up the first distance reached. */
+
+static void __afl_reset_area(void)
+{
+
+    u32 i;
+
+    memset(__afl_area_ptr, 0, MAP_SIZE + FGO_TARGET_MAX_COUNT * FGO_DIST_SLOT_SIZE);
+
+    for (i = 0; i < FGO_TARGET_MAX_COUNT; ++i)
+        *(u64 *)(__afl_area_ptr + MAP_SIZE + i * FGO_DIST_SLOT_SIZE + FGO_DIST_SLOT_MIN_OFFSET) =
+            INT32_MAX;
+}
+
+/* A simplified persistent mode handler, used as explained in README.llvm.
+   Between iterations, afl-fuzz resets the bitmap and the distance slots of
+   the active targets in run_target() before waking the stopped child up, so
+   only the first pass needs to discard whatever was recorded before the
+   loop. */
 
 int __afl_persistent_loop(unsigned int max_cnt)
 {
@@ -200,7 +325,7 @@ int __afl_persistent_loop(unsigned int max_cnt)
 
         if (is_persistent) {
 
-            memset(__afl_area_ptr, 0, MAP_SIZE + 16);
+            __afl_reset_area();
             __afl_area_ptr[0] = 1;
             __afl_prev_loc = 0;
         }
@@ -219,6 +344,8 @@ int __afl_persistent_loop(unsigned int max_cnt)
             __afl_area_ptr[0] = 1;
             __afl_prev_loc = 0;
 
+            if (__afl_fuzz_opts & FS_OPT_SHDMEM_STDIN) __afl_fuzz_fill_stdin();
+
             return 1;
         }
         else {
@@ -262,6 +389,57 @@ __attribute__((constructor(CONST_PRIO))) void __afl_auto_init(void)
     __afl_manual_init();
 }
 
+/* Comparison logging, called by the pass before the integer comparisons in
+   the blocks with a DF distance. The operands are zero-extended to 64 bits,
+   and size is their width in bytes. */
+
+void __fgo_cmplog_ins(u32 id, u64 v0, u64 v1, u8 size)
+{
+
+    struct cmp_header *h;
+    struct cmp_operands *ops;
+
+    if (!__fgo_cmp_map || !__fgo_cmp_map->active) return;
+
+    h = &__fgo_cmp_map->headers[id % CMP_MAP_W];
+    ops = &__fgo_cmp_map->log[id % CMP_MAP_W].ops[h->hits++ % CMP_MAP_H];
+
+    h->type = CMP_TYPE_INS;
+    h->size = size;
+    ops->v0 = v0;
+    ops->v1 = v1;
+}
+
+/* The same, before calls to strcmp()/memcmp()-style routines. Up to
+   CMP_RTN_LEN bytes of both buffers are logged: n of them for the memory
+   routines, and at most n up to the terminator for the string routines,
+   where n is CMP_RTN_UNBOUNDED if unbounded. Nothing is compared, thus
+   logged, when n is 0. */
+
+void __fgo_cmplog_rtn(u32 id, const u8 *p0, const u8 *p1, u64 n, u8 is_str)
+{
+
+    struct cmp_header *h;
+    struct cmp_rtn_operands *rtn;
+    u32 l0, l1;
+
+    if (!__fgo_cmp_map || !__fgo_cmp_map->active || !p0 || !p1 || !n) return;
+
+    if (n > CMP_RTN_LEN) n = CMP_RTN_LEN;
+
+    l0 = is_str ? strnlen((const char *)p0, n) : n;
+    l1 = is_str ? strnlen((const char *)p1, n) : n;
+
+    h = &__fgo_cmp_map->headers[id % CMP_MAP_W];
+    rtn = &__fgo_cmp_map->log[id % CMP_MAP_W].rtn[h->hits++ % CMP_MAP_H];
+
+    h->type = CMP_TYPE_RTN;
+    h->size = l0 > l1 ? l0 : l1;
+    memset(rtn, 0, sizeof(struct cmp_rtn_operands));
+    memcpy(rtn->v0, p0, l0);
+    memcpy(rtn->v1, p1, l1);
+}
+
 /* The following stuff deals with supporting -fsanitize-coverage=trace-pc-guard.
    It remains non-operational in the traditional, plugin-backed LLVM mode.
    For more info about 'trace-pc-guard', see README.llvm.
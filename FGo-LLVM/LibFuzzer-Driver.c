@@ -0,0 +1,193 @@
+/*
+   FGo - libFuzzer-style driver
+   ----------------------------
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   This object provides main() for harnesses written against the libFuzzer
+   API. Link it next to llvm-runtime (fgo-clang does this for
+   -fsanitize=fuzzer). Under afl-fuzz, LLVMFuzzerInitialize() runs once
+   before the deferred fork server starts, and LLVMFuzzerTestOneInput() is
+   then called in a persistent loop. The test case comes from the shared
+   memory buffer when afl-fuzz negotiated it (AFL_SHM_FUZZ), from the last
+   non-option argument (@@), or from stdin. FGO_DRIVER_LOOPS sets the number
+   of iterations before the process is restarted (default 1000).
+
+   Every test case is copied into a heap buffer of its exact size before it
+   is handed to the harness, so that ASan catches reads past its end.
+
+   Outside afl-fuzz, every file given on the command line (or stdin, without
+   any) is run once, which is handy for reproducing crashes.
+
+*/
+
+#include "../AFL-Fuzz/config.h"
+#include "../AFL-Fuzz/types.h"
+#include "../Utility/FGoDefs.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifndef DRIVER_DEFAULT_LOOPS
+    #define DRIVER_DEFAULT_LOOPS 1000
+#endif
+
+/* libFuzzer API implemented by the harness. */
+
+int LLVMFuzzerTestOneInput(const u8 *data, size_t size);
+__attribute__((weak)) int LLVMFuzzerInitialize(int *argc, char ***argv);
+
+/* FGo runtime interface. */
+
+int __afl_persistent_loop(unsigned int max_cnt);
+void __afl_manual_init(void);
+u32 __afl_fuzz_testcase_len(void);
+extern u8 *__afl_fuzz_ptr;
+
+/* Ask the runtime for the shared test case buffer instead of stdin. */
+
+int __afl_sharedmem_fuzzing = 1;
+
+/* Signatures making afl-fuzz enable the persistent and deferred modes. */
+
+__attribute__((used)) static volatile const char *persist_sig = PERSIST_SIG;
+__attribute__((used)) static volatile const char *defer_sig = DEFER_SIG;
+
+/* Buffer for test cases read from files or stdin. */
+
+static u8 input_buf[MAX_FILE];
+
+/* Read the whole test case from fd into input_buf. */
+
+static size_t read_input(s32 fd)
+{
+
+    size_t len = 0;
+    ssize_t res;
+
+    while (len < MAX_FILE && (res = read(fd, input_buf + len, MAX_FILE - len)) > 0)
+        len += res;
+
+    return len;
+}
+
+/* Read the test case from a file, reopening it on every call as required in
+   persistent mode. */
+
+static size_t read_input_file(const char *path)
+{
+
+    size_t len;
+    s32 fd = open(path, O_RDONLY);
+
+    if (fd < 0) {
+        fprintf(stderr, "[-] Unable to open '%s'\n", path);
+        return 0;
+    }
+
+    len = read_input(fd);
+    close(fd);
+
+    return len;
+}
+
+/* Hand a test case to the harness through an exact-size heap copy. */
+
+static void run_input(const u8 *data, size_t len)
+{
+
+    u8 *copy = malloc(len ? len : 1);
+
+    if (!copy) {
+        fprintf(stderr, "[-] Unable to allocate %zu bytes\n", len);
+        abort();
+    }
+
+    memcpy(copy, data, len);
+    LLVMFuzzerTestOneInput(copy, len);
+    free(copy);
+}
+
+/* Run every file on the command line (or stdin, without any) once. */
+
+static int run_once(int argc, char **argv)
+{
+
+    int i, files = 0;
+
+    for (i = 1; i < argc; ++i) {
+        size_t len;
+        if (argv[i][0] == '-') continue;
+        len = read_input_file(argv[i]);
+        fprintf(stderr, "Running: %s (%zu bytes)\n", argv[i], len);
+        run_input(input_buf, len);
+        ++files;
+    }
+
+    if (!files) run_input(input_buf, read_input(0));
+
+    return 0;
+}
+
+/* Main entry point. */
+
+int main(int argc, char **argv)
+{
+
+    u32 loops = DRIVER_DEFAULT_LOOPS;
+    u8 *loops_str = getenv(DRIVER_LOOPS_ENVAR);
+    const char *input_file = NULL;
+    int i;
+
+    if (LLVMFuzzerInitialize) LLVMFuzzerInitialize(&argc, &argv);
+
+    if (!getenv(SHM_ENV_VAR)) return run_once(argc, argv);
+
+    if (loops_str) {
+        loops = atoi(loops_str);
+        if (!loops) loops = 1;
+    }
+
+    /* libFuzzer-style flags (-runs=N and the like) are not input files. */
+
+    for (i = argc - 1; i > 0 && !input_file; --i)
+        if (argv[i][0] != '-') input_file = argv[i];
+
+    /* The fork server starts here, so that the initialization above is done
+       only once. */
+
+    __afl_manual_init();
+
+    /* The first pass of the loop discards the coverage and the distances
+       recorded during initialization; afl-fuzz resets them before every
+       further iteration. Crashes and hangs simply take the child down and
+       are picked up by afl-fuzz from the wait status. */
+
+    while (__afl_persistent_loop(loops)) {
+
+        const u8 *data = input_buf;
+        size_t len;
+
+        if (__afl_fuzz_ptr) {
+            data = __afl_fuzz_ptr;
+            len = __afl_fuzz_testcase_len();
+        }
+        else if (input_file)
+            len = read_input_file(input_file);
+        else {
+            lseek(0, 0, SEEK_SET);
+            len = read_input(0);
+        }
+
+        run_input(data, len);
+    }
+
+    return 0;
+}
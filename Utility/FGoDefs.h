@@ -16,6 +16,15 @@
 // Environment variable name for usage of native clang
 #define NATIVE_CLANG_ENVAR "FGO_NATIVE_CLANG"
 
+// Environment variable name for the persistent loop count of the libFuzzer-style driver
+#define DRIVER_LOOPS_ENVAR "FGO_DRIVER_LOOPS"
+
+// Environment variable name for inserting the deferred fork server at the analyzed point
+#define AUTO_DEFER_ENVAR "FGO_AUTO_DEFER"
+
+// Environment variable name for stopping the fuzzer once all targets are reached
+#define EXIT_WHEN_REACHED_ENVAR "FGO_EXIT_WHEN_REACHED"
+
 // LLVM option name for distance directory
 #define LLVM_OPT_DISTDIR_NAME "distdir"
 
@@ -34,12 +43,52 @@
 // Name of backtrace distance file
 #define BT_DISTANCE_FILENAME "bb.distance.bt"
 
+// Name of directory containing per-source-file distance shards
+#define DIST_SHARD_DIRNAME "bb.distance.shards"
+
+// Name of index file of distance shards (hash, shard file, source file)
+#define DIST_SHARD_INDEX_FILENAME "shards.index"
+
+// Environment variable name for the object cache directory of the compiler wrapper
+#define OBJ_CACHE_DIR_ENVAR "FGO_OBJ_CACHE_DIR"
+
+// Name of file containing the analyzed point for the deferred fork server
+#define DEFER_POINT_FILENAME "defer.point"
+
 // Name of target information file for fuzzing
 #define TARGET_INFO_FILENAME "target.info"
 
+// Name of the object section holding the bitmap indices, plus one, of the edges that can
+// reach a target, as u32. The linker concatenates those of all the objects of a binary.
+#define REACH_EDGES_SECTION "fgo_reach_edges"
+
+// Name of the object section holding the dictionary of the tokens near the targets, in
+// the format of `afl-fuzz -x`. The linker concatenates those of all the objects of a binary.
+#define TARGET_DICT_SECTION "fgo_target_dict"
+
+// Environment variable name for the maximal distance of the code tokens are collected from
+#define DICT_MAX_DIST_ENVAR "FGO_DICT_MAX_DIST"
+
+// Environment variable name for the maximal distance of the functions ASan is kept in
+#define ASAN_MAX_DIST_ENVAR "FGO_ASAN_MAX_DIST"
+
 // FGo Parameter: a maximal count for target locations
 #define FGO_TARGET_MAX_COUNT 64
 
+// Size of the distance slot of a target in SHM (counts, sums and minimum as u64)
+#define FGO_DIST_SLOT_SIZE 40
+
+// Offsets of the fields in the distance slot of a target: the count and the sum of the
+// DF distances, the count and the sum of the BT distances, and the minimal distance
+#define FGO_DIST_SLOT_DF_CNT_OFFSET 0
+#define FGO_DIST_SLOT_DF_DIST_OFFSET 8
+#define FGO_DIST_SLOT_BT_CNT_OFFSET 16
+#define FGO_DIST_SLOT_BT_DIST_OFFSET 24
+#define FGO_DIST_SLOT_MIN_OFFSET 32
+
+// FGo Parameter: a default maximal distance of the code tokens are collected from
+#define FGO_DICT_MAX_DIST 200
+
 // FGo Parameter: a constant distance for an external function call
 #define FGO_EXTERNAL_CALL_DIST 50
 
@@ -68,6 +68,7 @@ void helper_load_target_info(const char *info_dir, target_info_t *target_info)
     target_info->target_start = NULL;
     target_info->quantile_size = NULL;
     target_info->target_quantile = NULL;
+    target_info->target_weight = NULL;
     if (0 != (*parse)(info_dir, target_info))
         FATAL("Failed to parse target information. Error: %s", parse_error());
 
@@ -79,9 +80,9 @@ double helper_get_quantile(
     const target_info_t *target_info, uint32_t target_id, uint32_t distance
 )
 {
+    if (distance < target_info->target_start[target_id]) return 0.0;
     uint32_t quantile_index = distance - target_info->target_start[target_id];
-    if (quantile_index < 0) return 0.0;
-    else if (quantile_index >= target_info->quantile_size[target_id]) return 1.0;
+    if (quantile_index >= target_info->quantile_size[target_id]) return 1.0;
     else return target_info->target_quantile[target_id][quantile_index];
 }
 
@@ -92,6 +93,7 @@ void helper_free_target_info(target_info_t *target_info)
             SAFE_FREE(target_info->target_quantile[i]);
     }
     SAFE_FREE(target_info->target_quantile);
+    SAFE_FREE(target_info->target_weight);
     SAFE_FREE(target_info->quantile_size);
     SAFE_FREE(target_info->target_start);
 }
\ No newline at end of file
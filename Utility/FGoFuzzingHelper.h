@@ -19,6 +19,7 @@ typedef struct __target_info_t
     uint32_t *target_start;
     uint32_t *quantile_size;
     double **target_quantile;
+    double *target_weight;
 } target_info_t;
 
 /// @brief Load target information from a Json file under directory `info_dir`.
@@ -32,7 +33,8 @@ void helper_load_target_info(const char *info_dir, target_info_t *target_info);
 /// function doesn't check the validity of the given pointers for fast invocation.
 /// @param target_id
 /// @param distance
-/// @return
+/// @return 0.0 for distances below the start of the target's distribution,
+/// 1.0 for distances beyond its end
 double helper_get_quantile(
     const target_info_t *target_info, uint32_t target_id, uint32_t distance
 );
@@ -103,6 +103,7 @@ int parse(const std::string &infoDirectory, target_info_t *target_info)
     target_info->target_start = (uint32_t *)malloc(sizeof(uint32_t) * targetCount);
     target_info->quantile_size = (uint32_t *)malloc(sizeof(uint32_t) * targetCount);
     target_info->target_quantile = (double **)malloc(sizeof(double *) * targetCount);
+    target_info->target_weight = (double *)malloc(sizeof(double) * targetCount);
     for (Json::Value::ArrayIndex i = 0; i < targetCount; ++i) {
         if (!root["TargetInfo"][i].isMember("Start") ||
             (root["TargetInfo"][i]["Start"].type() != Json::uintValue &&
@@ -125,6 +126,23 @@ int parse(const std::string &infoDirectory, target_info_t *target_info)
         }
         target_info->target_start[i] = root["TargetInfo"][i]["Start"].asUInt();
 
+        // Files written before weights were supported have no 'Weight'. As
+        // in the analyzer, a weight must be positive: a zero weight would
+        // drop the target from the seed energy.
+        target_info->target_weight[i] = 1.0;
+        if (root["TargetInfo"][i].isMember("Weight")) {
+            if (!root["TargetInfo"][i]["Weight"].isNumeric() ||
+                !(root["TargetInfo"][i]["Weight"].asDouble() > 0.0))
+            {
+                globalError = "Invalid item 'Weight' at Target " + std::to_string(i) +
+                              ". The target "
+                              "information file '" +
+                              infoJsonFile.string() + "' maybe destroyed";
+                return -1;
+            }
+            target_info->target_weight[i] = root["TargetInfo"][i]["Weight"].asDouble();
+        }
+
         Json::Value::ArrayIndex quantileSize = root["TargetInfo"][i]["Quantile"].size();
         target_info->quantile_size[i] = quantileSize;
         target_info->target_quantile[i] = (double *)malloc(sizeof(double) * quantileSize);